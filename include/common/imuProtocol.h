@@ -0,0 +1,316 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef IMUPROTOCOL_H
+#define IMUPROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+
+/*
+ * Wire protocol shared by the server and the mechanism's client.
+ *
+ * IMU characteristic notifications are [format byte][payload]. The one exception is the legacy
+ * format, which is the bare 16 byte [w,x,y,z] float payload with no format byte. Servers send
+ * it until a client selects something else, so old clients keep working.
+ *
+ * The control characteristic reads as [PROTOCOL_VERSION][supported format mask][supported field
+ * mask][supported transport mask] and accepts [ImuCommand][args...] writes. A client reads it
+ * after connecting, picks the best format both sides support, and writes SET_FORMAT. SET_PROFILE
+ * may be written at any time. Servers from before the field mask existed send only the first two
+ * bytes, and servers from before the transport mask only the first three.
+ *
+ * EXTENDED packets are [EXTENDED][field mask][fields...]. The mask is the schema: the fields
+ * present follow in ImuField order, each with the layout given there. The quaternion is always
+ * present. A packet that would be 16 bytes gets a pad byte so it is never taken for a legacy
+ * packet. Packets longer than 20 bytes need the client to have exchanged a larger MTU.
+ *
+ * BATCH notifications are [BATCH][count][packets...]: count whole packets of the negotiated
+ * format back to back, oldest first, each with its own format byte. They are only sent after the
+ * client writes SET_BATCH, and never in the legacy format. Like EXTENDED, a 16 byte batch gets a
+ * pad byte. BATCH is a container, so it is advertised in the format mask but cannot be selected
+ * with SET_FORMAT.
+ *
+ * A client that writes SET_TRANSPORT L2CAP gets the same notifications as SDUs on an L2CAP
+ * connection-oriented channel instead, which the server opens to the client's L2CAP_PSM. SDUs keep
+ * their boundaries, so each frame is exactly one notification's bytes. Control stays on GATT, and
+ * the server falls back to notifications whenever the channel is closed.
+ *
+ * Servers built with periodic advertising also broadcast every sample, connected or not, so a
+ * client can follow the stream without a connection. A non-connectable extended advertising set
+ * with BROADCAST_SID names the service, and its periodic train carries one manufacturer specific
+ * AD structure: [length][0xFF][BROADCAST_COMPANY_ID, little-endian][BATCH]. The batch holds the
+ * newest few samples as EXTENDED packets with BROADCAST_FIELDS, so a missed train event is
+ * recovered from the next one. Clients skip sequence numbers they already have.
+ */
+
+// Bumped only for changes old peers cannot detect. Additions so far are found from the length of
+// the capability read and from the format and field masks, so they keep version 1
+constexpr uint8_t PROTOCOL_VERSION = 1;
+constexpr size_t LEGACY_PACKET_SIZE = 16;   // Size of a legacy raw float packet
+constexpr size_t MAX_PACKET_SIZE = 28;      // Largest packet of any format
+constexpr size_t BATCH_HEADER_SIZE = 2;     // [BATCH][count]
+constexpr size_t MAX_NOTIFICATION_SIZE = 244;   // Largest notification that fits one LE data
+                                                // packet with data length extension
+constexpr uint16_t L2CAP_PSM = 0x0080;      // LE PSM the client listens on (first dynamic PSM)
+constexpr uint16_t L2CAP_SDU_SIZE = MAX_NOTIFICATION_SIZE;  // Largest SDU on the channel
+constexpr uint8_t BROADCAST_SID = 1;        // Advertising set ID of the broadcast
+constexpr uint16_t BROADCAST_COMPANY_ID = 0xFFFF;   // Manufacturer data company ID (reserved for
+                                                    // testing by the Bluetooth SIG)
+constexpr size_t BROADCAST_HEADER_SIZE = 4; // [length][0xFF][company ID]
+
+/**
+ * Quaternion encodings for the IMU characteristic
+ */
+enum class ImuFormat : uint8_t {
+    LEGACY = 0,             // 16 bytes: 4 floats, no format byte
+    RAW_FLOAT = 1,          // 16 bytes: 4 floats
+    SMALLEST_THREE_32 = 2,  // 4 bytes: 2 bit index + 3 x 10 bit components
+    SMALLEST_THREE_48 = 3,  // 6 bytes: 2 bit index + 3 x 15 bit components
+    DMP_Q14 = 4,            // 8 bytes: the DMP's 4 big-endian Q14 words, forwarded untouched
+    EXTENDED = 5,           // 10-28 bytes: field mask + the fields it selects (+ pad)
+    BATCH = 6,              // Variable: count + that many packets (+ pad)
+    COUNT
+};
+
+/**
+ * Fields of an EXTENDED packet, in wire order
+ */
+enum class ImuField : uint8_t {
+    QUATERNION = 0, // 8 bytes: 4 big-endian Q14 words [w,x,y,z] (always present)
+    GYRO = 1,       // 6 bytes: 3 big-endian DMP gyro words [x,y,z], 16.4 LSB per deg/s
+    ACCEL = 2,      // 6 bytes: 3 big-endian DMP accel words [x,y,z], 8192 LSB per g
+    SEQUENCE = 3,   // 2 bytes: little-endian sample counter, wraps at 65536
+    TIMESTAMP = 4,  // 4 bytes: little-endian server clock in us when the IMU took the sample,
+                    // wraps after about 71 minutes
+    COUNT
+};
+
+/**
+ * How IMU packets reach the client
+ */
+enum class ImuTransport : uint8_t {
+    NOTIFY = 0,     // IMU characteristic notifications
+    L2CAP = 1,      // SDUs on an L2CAP connection-oriented channel
+    COUNT
+};
+
+/**
+ * A decoded IMU sample. Only the fields in fields hold values
+ */
+struct ImuSample {
+    std::array<float, 4> quaternion{};  // w, x, y, z
+    std::array<float, 3> gyro{};        // Body rates in rad/s
+    std::array<float, 3> accel{};       // Acceleration in g
+    uint16_t sequence = 0;              // Sample counter
+    uint32_t timestamp = 0;             // Server clock in us when the sample was taken
+    uint8_t fields = 0;                 // Mask of the fields that were decoded
+};
+
+/**
+ * Commands written to the control characteristic
+ */
+enum class ImuCommand : uint8_t {
+    SET_FORMAT = 1, // [SET_FORMAT][ImuFormat] or [SET_FORMAT][EXTENDED][field mask]
+    SET_PROFILE = 2, // [SET_PROFILE][ImuProfile]
+    SET_BATCH = 3,  // [SET_BATCH][max samples][max delay in ms]. 1 sample turns batching off
+    SET_TRANSPORT = 4   // [SET_TRANSPORT][ImuTransport]
+};
+
+/**
+ * DMP output rate and low-pass filter pairs, from lowest latency to lowest noise
+ */
+enum class ImuProfile : uint8_t {
+    LOW_LATENCY = 0,    // 200 Hz output, 188 Hz DLPF
+    BALANCED = 1,       // 100 Hz output, 42 Hz DLPF (the MotionApps20 default)
+    LOW_NOISE = 2,      // 50 Hz output, 20 Hz DLPF
+    COUNT
+};
+
+/**
+ * Get the bit for a format in a supported format mask
+ *
+ * @param format - The format
+ * @return The mask bit
+ */
+constexpr uint8_t formatBit(ImuFormat format) { return 1u << static_cast<uint8_t>(format); }
+
+/**
+ * Get the bit for a field in a field mask
+ *
+ * @param field - The field
+ * @return The mask bit
+ */
+constexpr uint8_t fieldBit(ImuField field) { return 1u << static_cast<uint8_t>(field); }
+
+/**
+ * Get the bit for a transport in a supported transport mask
+ *
+ * @param transport - The transport
+ * @return The mask bit
+ */
+constexpr uint8_t transportBit(ImuTransport transport) {
+    return 1u << static_cast<uint8_t>(transport);
+}
+
+// The EXTENDED fields of broadcast packets
+constexpr uint8_t BROADCAST_FIELDS = fieldBit(ImuField::QUATERNION) | fieldBit(ImuField::SEQUENCE) |
+                                     fieldBit(ImuField::TIMESTAMP);
+
+/**
+ * Encodes and decodes IMU packets
+ */
+class ImuCodec {
+public:
+    // Static methods only
+    ImuCodec() = delete;
+
+    /**
+     * Get the mask of formats this build can encode and decode
+     *
+     * @return The supported format mask
+     */
+    static uint8_t supportedFormats();
+
+    /**
+     * Get the mask of EXTENDED fields this build can encode and decode
+     *
+     * @return The supported field mask
+     */
+    static uint8_t supportedFields();
+
+    /**
+     * Get the size of a packet in a format, including the format byte
+     *
+     * @param format - The format
+     * @param fields - The field mask, for EXTENDED packets
+     * @return The packet size in bytes (0 if unknown)
+     */
+    static size_t packetSize(ImuFormat format, uint8_t fields = fieldBit(ImuField::QUATERNION));
+
+    /**
+     * Encode a unit quaternion into a packet
+     *
+     * @param format - The format to encode in
+     * @param q - The quaternion {w, x, y, z}
+     * @param out - Where to write the packet (at least MAX_PACKET_SIZE bytes)
+     * @return The number of bytes written (0 if the format is unknown or EXTENDED, which is only
+     *         encoded from DMP packets)
+     */
+    static size_t encode(ImuFormat format, const std::array<float, 4> &q, uint8_t *out);
+
+    /**
+     * Encode straight from a MotionApps20 DMP FIFO packet. DMP_Q14 and EXTENDED copy the
+     * fixed-point words as-is; every other format converts to float first, as
+     * dmpGetQuaternion(Quaternion*) does
+     *
+     * @param format - The format to encode in
+     * @param dmpPacket - The DMP FIFO packet (quaternion, gyro, then accel as big-endian words)
+     * @param out - Where to write the packet (at least MAX_PACKET_SIZE bytes)
+     * @param fields - The field mask, for EXTENDED packets
+     * @param sequence - The sample counter, for EXTENDED packets with SEQUENCE
+     * @param timestamp - When the sample was taken in us, for EXTENDED packets with TIMESTAMP
+     * @return The number of bytes written (0 if the format is unknown)
+     */
+    static size_t encodeDmpPacket(ImuFormat format, const uint8_t *dmpPacket, uint8_t *out,
+                                  uint8_t fields = fieldBit(ImuField::QUATERNION),
+                                  uint16_t sequence = 0, uint32_t timestamp = 0);
+
+    /**
+     * Write the header of a batch whose packets were encoded at batch + BATCH_HEADER_SIZE, and
+     * pad it if needed
+     *
+     * @param batch - The batch (at least length + 1 bytes)
+     * @param length - The length of the batch including the header
+     * @param count - The number of packets in the batch
+     * @return The length of the finished batch
+     */
+    static size_t finishBatch(uint8_t *batch, size_t length, uint8_t count);
+
+    /**
+     * Get the length of the packet at the start of some data from its header, to find where
+     * each packet in a batch ends. Legacy packets and batches have no such header
+     *
+     * @param data - The packet
+     * @param length - The number of bytes available
+     * @return The packet length (0 if unknown or longer than length)
+     */
+    static size_t packetLength(const uint8_t *data, size_t length);
+
+    /**
+     * Check that a packet is well formed without decoding it
+     *
+     * @param data - The packet
+     * @param length - The length of the packet
+     * @return True if decode() would accept the packet
+     */
+    static bool isValid(const uint8_t *data, size_t length);
+
+    /**
+     * Decode a packet of any format into a quaternion. Batches decode their newest packet
+     *
+     * @param data - The packet
+     * @param length - The length of the packet
+     * @param q - Where to store the quaternion {w, x, y, z}
+     * @return True if the packet was valid
+     */
+    static bool decode(const uint8_t *data, size_t length, std::array<float, 4> &q);
+
+    /**
+     * Decode only the wanted fields of a packet. Non-EXTENDED packets only hold a quaternion.
+     * Batches decode their newest packet
+     *
+     * @param data - The packet
+     * @param length - The length of the packet
+     * @param sample - Where to store the fields. sample.fields is set to those decoded
+     * @param fields - The mask of fields to decode
+     * @return True if the packet was valid
+     */
+    static bool decode(const uint8_t *data, size_t length, ImuSample &sample, uint8_t fields);
+
+    /**
+     * Choose the format to use from the formats a server supports. Prefers the requested format
+     * and falls back to the format with the best precision per byte that both sides share
+     *
+     * @param serverFormats - The server's supported format mask
+     * @param preferred - The client's preferred format
+     * @return The chosen format
+     */
+    static ImuFormat negotiate(uint8_t serverFormats, ImuFormat preferred);
+
+private:
+    /**
+     * Find the newest packet in a valid batch
+     *
+     * @param batch - The batch
+     * @param length - The length of the batch
+     * @param newestLength - Where to store the newest packet's length
+     * @return The newest packet
+     */
+    static const uint8_t *newestInBatch(const uint8_t *batch, size_t length,
+                                        size_t &newestLength);
+
+    /**
+     * Pack a quaternion with the smallest-three scheme: drop the largest magnitude component,
+     * make it positive by negating the whole quaternion, and quantize the other three. The
+     * dropped component is rebuilt from the unit norm on decode
+     *
+     * @param q - The unit quaternion {w, x, y, z}
+     * @param bits - The bits per component
+     * @return The packed index and components
+     */
+    static uint64_t packSmallestThree(const std::array<float, 4> &q, uint8_t bits);
+
+    /**
+     * Unpack a smallest-three quaternion
+     *
+     * @param packed - The packed index and components
+     * @param bits - The bits per component
+     * @param q - Where to store the quaternion {w, x, y, z}
+     */
+    static void unpackSmallestThree(uint64_t packed, uint8_t bits, std::array<float, 4> &q);
+};
+
+#endif // IMUPROTOCOL_H
@@ -0,0 +1,26 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef L2CAPSDU_H
+#define L2CAPSDU_H
+
+#include <cstdint>
+#include <nimble/nimble/host/include/host/ble_hs.h>
+
+/*
+ * Helpers for the L2CAP connection-oriented channels the server, the mechanism's client, and the
+ * L2CAP throughput test open. NimBLE hands each received SDU over for good, so every channel
+ * needs a fresh buffer after each one
+ */
+
+/**
+ * Give an L2CAP channel a buffer for its next SDU. A channel without one stops receiving for good
+ *
+ * @param channel - The channel
+ * @param size - The size of the buffer
+ * @return 0 on success, otherwise a BLE_HS_ error code
+ */
+int readyNextSdu(ble_l2cap_chan *channel, uint16_t size);
+
+#endif // L2CAPSDU_H
@@ -0,0 +1,105 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A preallocated ring of samples with one producer and one consumer, such as the task reading
+ * the IMU and the task transmitting its samples. Neither side blocks or locks; the indices are
+ * atomic and each is written by one side only. When the ring is full new samples are refused and
+ * counted as lost, since the producer cannot safely overwrite a slot the consumer may be reading
+ *
+ * @tparam T - The sample type
+ * @tparam CAPACITY - The number of slots (a power of two)
+ */
+template<typename T, size_t CAPACITY>
+class SampleRing {
+public:
+    /**
+     * Primary constructor
+     */
+    SampleRing() = default;
+
+    // Delete copy-constructor and assignment-op
+    SampleRing(const SampleRing &) = delete;
+    SampleRing &operator=(const SampleRing &) = delete;
+
+    /**
+     * Producer - get the next free slot to fill. Counts a lost sample if the ring is full
+     *
+     * @return The slot, or nullptr if the ring is full
+     */
+    T *claim() {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == CAPACITY) {
+            lost.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        return &slots[h & (CAPACITY - 1)];
+    }
+
+    /**
+     * Producer - make the slot from claim() visible to the consumer
+     */
+    void publish() { head.fetch_add(1, std::memory_order_release); }
+
+    /**
+     * Consumer - get the oldest sample without removing it
+     *
+     * @return The sample, or nullptr if the ring is empty
+     */
+    const T *peek() const {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+
+        return &slots[t & (CAPACITY - 1)];
+    }
+
+    /**
+     * Consumer - remove the sample from peek()
+     */
+    void release() { tail.fetch_add(1, std::memory_order_release); }
+
+    /**
+     * Get the number of samples waiting
+     *
+     * @return The number of samples
+     */
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Get the number of samples refused because the ring was full
+     *
+     * @return The lost sample count
+     */
+    uint32_t getLost() const { return lost.load(std::memory_order_relaxed); }
+
+    /**
+     * Get the number of slots
+     *
+     * @return The capacity
+     */
+    static constexpr size_t capacity() { return CAPACITY; }
+
+private:
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+    // Member variables
+    T slots[CAPACITY]{};
+    std::atomic<size_t> head{0};    // Next slot to write, only written by the producer
+    std::atomic<size_t> tail{0};    // Next slot to read, only written by the consumer
+    std::atomic<uint32_t> lost{0};  // Samples refused while full
+};
+
+#endif // SAMPLERING_H
@@ -0,0 +1,85 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * A value with one writer and any number of readers, such as the latest sample shared from the
+ * task receiving it with the tasks using it. The writer never blocks or waits. Readers never lock;
+ * they copy the value and retry if it was written meanwhile, so every copy is whole. The value is
+ * held as atomic words, so the racing copies are well defined
+ *
+ * @tparam T - The value type (trivially copyable)
+ */
+template<typename T>
+class SeqLock {
+public:
+    /**
+     * Primary constructor
+     */
+    SeqLock() = default;
+
+    // Delete copy-constructor and assignment-op
+    SeqLock(const SeqLock &) = delete;
+    SeqLock &operator=(const SeqLock &) = delete;
+
+    /**
+     * Writer - replace the value
+     *
+     * @param value - The new value
+     */
+    void write(const T &value) {
+        uint32_t buffer[WORDS]{};
+        memcpy(buffer, &value, sizeof(T));
+
+        // An odd sequence marks a write in progress
+        const uint32_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i(0); i < WORDS; ++i) {
+            words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    /**
+     * Reader - copy the value
+     *
+     * @param value - Where to store the copy
+     * @return The number of writes up to the copied one (0 if it was never written)
+     */
+    uint32_t read(T &value) const {
+        uint32_t buffer[WORDS];
+        uint32_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            for (size_t i(0); i < WORDS; ++i) {
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        memcpy(&value, buffer, sizeof(T));
+        return before / 2;
+    }
+
+private:
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+    // Member variables
+    std::atomic<uint32_t> words[WORDS]{};   // The value, copied word by word
+    std::atomic<uint32_t> sequence{0};      // Twice the completed writes, odd during a write
+};
+
+#endif // SEQLOCK_H
@@ -1,6 +1,6 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 11/25/2024
+// Last Modified: 10/18/2026
 
 #ifndef CONTROLALGOIMPL_H
 #define CONTROLALGOIMPL_H
@@ -8,6 +8,8 @@
 #include <Arduino.h>
 #include <ArduinoLog.h>
 #include "control/extendedQuaternion.h"
+#include "control/mechanismGeometry.h"
+#include "control/orientation.h"
 #include "mechanism/clientHandler.h"
 #include "mechanism/motorHandler.h"
 
@@ -38,12 +40,31 @@ private:
      * @return
      */
     ExtendedQuaternion slerp();
+
+    /**
+     * Calculate the body frame angular velocity between the previous and current interpolated
+     * orientations using the quaternion log map. The first call after construction has no
+     * previous orientation and reports zero
+     */
     void calculateAngularVelocity();
+
+    /**
+     * Rotate the wheels' contact and drive directions into the body frame and project the
+     * angular velocity onto them, giving each wheel's surface speed per unit eyeball radius.
+     * The six rotations share one cached rotation matrix
+     */
     void applyInverseKinematics();
     virtual void PID();
 
     // Member variables
-
+    ExtendedQuaternion interpolated; // Latest output of slerp
+    ExtendedQuaternion prevInterpolated; // Output of slerp on the previous execution
+    uint32_t prevTime = 0;  // Time of the previous execution in us
+    bool hasPrev = false;   // If prevInterpolated and prevTime are valid
+    VectorFloat angularVelocity; // Body frame angular velocity in rad/s
+    Orientation bodyFromMechanism; // Rotation from the mechanism frame to the body frame
+    float wheelRates[MechanismGeometry::WHEEL_COUNT] = {}; // Surface speed of each wheel per
+                                                            // unit eyeball radius in rad/s
 };
 
 #endif // CONTROLALGOIMPL_H
\ No newline at end of file
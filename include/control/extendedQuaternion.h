@@ -1,22 +1,46 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 11/28/2024
+// Last Modified: 10/18/2026
 
 #ifndef EXTENDEDQUATERNION_H
 #define EXTENDEDQUATERNION_H
 
 #include <Arduino.h>
 #include "../lib/MPU6050/helper_3dmath.h"
+#include "control/fastMath.h"
 
 /**
- * A class to extend Quaternion with additional calculations
+ * A row-major 3x3 rotation matrix
+ */
+struct RotationMatrix {
+    /**
+     * Rotate a vector by the matrix
+     *
+     * @param v - The vector to rotate
+     * @return The rotated vector
+     */
+    constexpr VectorFloat apply(const VectorFloat &v) const {
+        return {m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z};
+    }
+
+    // Member variables
+    float m[3][3];
+};
+
+/**
+ * A class to extend Quaternion with additional calculations. The core algebra is constexpr so
+ * fixed geometry can be built and checked at compile time. Quaternion's methods are not virtual,
+ * so none of these reuse their names: a call through a Quaternion reference would silently run
+ * the helper_3dmath version instead
  */
 class ExtendedQuaternion final : public Quaternion {
 public:
     /**
      * Primary constructor - default values
      */
-    ExtendedQuaternion();
+    constexpr ExtendedQuaternion() : Quaternion() {}
 
     /**
      * Secondary constructor - known values
@@ -26,14 +50,53 @@ public:
      * @param y
      * @param z
      */
-    ExtendedQuaternion(float w, float x, float y, float z);
+    constexpr ExtendedQuaternion(float w, float x, float y, float z) : Quaternion(w, x, y, z) {}
+
+    /**
+     * Conversion constructor - from a helper_3dmath quaternion
+     *
+     * @param q - The quaternion to copy
+     */
+    constexpr explicit ExtendedQuaternion(const Quaternion &q) : Quaternion(q.w, q.x, q.y, q.z) {}
 
     // Default copy-constructor and assignment-op
-    ExtendedQuaternion(const ExtendedQuaternion &) = default;
+    constexpr ExtendedQuaternion(const ExtendedQuaternion &) = default;
     ExtendedQuaternion &operator=(const ExtendedQuaternion &) = default;
 
+    /**
+     * Build the quaternion for a rotation about an axis. Usable at compile time
+     *
+     * @param axis - The unit axis of rotation
+     * @param angle - The angle of rotation in radians
+     * @return The unit quaternion
+     */
+    static constexpr ExtendedQuaternion fromAxisAngle(const VectorFloat &axis, float angle) {
+        const float s = FastMath::sinConstexpr(0.5f * angle);
+        return {FastMath::cosConstexpr(0.5f * angle), axis.x * s, axis.y * s, axis.z * s};
+    }
+
     // Operator overloads
-    ExtendedQuaternion operator-() const;
+    constexpr ExtendedQuaternion operator-() const { return {-w, -x, -y, -z}; }
+
+    /**
+     * Hamilton product
+     *
+     * @param rhs - The right hand quaternion
+     * @return this * rhs
+     */
+    constexpr ExtendedQuaternion operator*(const ExtendedQuaternion &rhs) const {
+        return {w * rhs.w - x * rhs.x - y * rhs.y - z * rhs.z,
+                w * rhs.x + x * rhs.w + y * rhs.z - z * rhs.y,
+                w * rhs.y - x * rhs.z + y * rhs.w + z * rhs.x,
+                w * rhs.z + x * rhs.y - y * rhs.x + z * rhs.w};
+    }
+
+    /**
+     * Get the conjugate. Equal to the inverse for unit quaternions
+     *
+     * @return [w, -x, -y, -z]
+     */
+    constexpr ExtendedQuaternion conjugate() const { return {w, -x, -y, -z}; }
 
     /**
      * Calculate the dot product between two quaternions
@@ -41,7 +104,9 @@ public:
      * @param rhs - The quaternion to take the dot product with
      * @return The dot product
      */
-    float dot(const Quaternion &rhs) const;
+    constexpr float dot(const Quaternion &rhs) const {
+        return (w * rhs.w) + (x * rhs.x) + (y * rhs.y) + (z * rhs.z);
+    }
 
     /**
     * Calculate the dot product between two quaternions
@@ -49,7 +114,97 @@ public:
     * @param rhs - The quaternion to take the dot product with
     * @return The dot product
     */
-    float dot(const ExtendedQuaternion &rhs) const;
+    constexpr float dot(const ExtendedQuaternion &rhs) const {
+        return (w * rhs.w) + (x * rhs.x) + (y * rhs.y) + (z * rhs.z);
+    }
+
+    /**
+     * Calculate the squared magnitude. Usable at compile time
+     *
+     * @return The squared magnitude
+     */
+    constexpr float squaredNorm() const { return dot(*this); }
+
+    /**
+     * Convert this unit quaternion to a rotation matrix
+     *
+     * @return The rotation matrix
+     */
+    constexpr RotationMatrix toRotationMatrix() const {
+        return {{{1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y - w * z), 2.0f * (x * z + w * y)},
+                 {2.0f * (x * y + w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z - w * x)},
+                 {2.0f * (x * z - w * y), 2.0f * (y * z + w * x), 1.0f - 2.0f * (x * x + y * y)}}};
+    }
+
+    /**
+     * Get a vector rotated by this unit quaternion. Usable at compile time
+     *
+     * @param v - The vector to rotate
+     * @return The rotated vector
+     */
+    constexpr VectorFloat getRotated(const VectorFloat &v) const {
+        return FastMath::getRotated(*this, v);
+    }
+
+    /**
+     * Logarithm of this unit quaternion. The result is the pure quaternion (0, v) where v is the
+     * rotation axis scaled by half the rotation angle. Quaternions near identity use a Taylor
+     * expansion instead of atan2/sin, which lose precision there. Canonicalize to w >= 0 first:
+     * -1 has no defined axis and its logarithm is returned as zero, the same as the identity's
+     *
+     * @return The vector part of the logarithm
+     */
+    VectorFloat log() const;
+
+    /**
+     * Exponential of a pure quaternion (0, v). The inverse of log() for unit quaternions. Small
+     * vectors use a Taylor expansion of sin(|v|)/|v| and cos(|v|)
+     *
+     * @param v - The vector part (half angle times axis)
+     * @return The unit quaternion
+     */
+    static ExtendedQuaternion exp(const VectorFloat &v);
+
+    /**
+     * Calculate the constant body frame angular velocity that takes one unit quaternion to
+     * another over a time step: w = 2 * log(conj(from) * to) / dt. The shorter of the two arcs
+     * is used
+     *
+     * @param from - The orientation at the start of the step
+     * @param to - The orientation at the end of the step
+     * @param dt - The length of the step in seconds (> 0)
+     * @return The angular velocity in rad/s
+     */
+    static VectorFloat angularVelocity(const ExtendedQuaternion &from,
+                                       const ExtendedQuaternion &to, float dt);
+
+    /**
+     * Calculate the magnitude in single precision, unlike Quaternion::getMagnitude, which goes
+     * through sqrt(double)
+     *
+     * @return The magnitude
+     */
+    float norm() const;
+
+    /**
+     * Normalize in place with the float-only FastMath path. Skipped when already unit length
+     */
+    void normalizeInPlace();
+
+    /**
+     * Get a normalized copy
+     *
+     * @return The normalized quaternion
+     */
+    ExtendedQuaternion normalized() const;
+
+    /**
+     * Rotate a vector by this unit quaternion with the direct formula rather than two
+     * quaternion products
+     *
+     * @param v - The vector to rotate in place
+     */
+    void rotate(VectorFloat &v) const;
 };
 
-#endif // EXTENDEDQUATERNION_H
\ No newline at end of file
+#endif // EXTENDEDQUATERNION_H
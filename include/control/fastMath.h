@@ -0,0 +1,190 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "../lib/MPU6050/helper_3dmath.h"
+
+/**
+ * Float-only replacements for the helper_3dmath operations used in hot paths. The helpers call
+ * sqrt(double), which the ESP32's single precision FPU has to emulate in software, and rotate
+ * vectors with two full quaternion products. Everything here stays in float
+ */
+class FastMath {
+public:
+    // Static helpers only
+    FastMath() = delete;
+
+    // Squared magnitudes within this distance of 1 are treated as already normalized
+    static constexpr float NORMALIZE_EPSILON = 1e-6f;
+
+    static constexpr float PI_F = 3.14159265358979f;    // Single precision pi
+
+    /**
+     * Approximate 1/sqrt(x) with the bit-level initial guess and one Newton step. The maximum
+     * relative error is about 1.8e-3
+     *
+     * @param x - The value to take the reciprocal square root of (x > 0)
+     * @return 1/sqrt(x)
+     */
+    static inline float invSqrt(float x) {
+        uint32_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+        bits = 0x5f3759dfu - (bits >> 1);
+
+        float y;
+        memcpy(&y, &bits, sizeof(y));
+        return y * (1.5f - 0.5f * x * y * y);
+    }
+
+    /**
+     * Calculate the magnitude of a quaternion in single precision
+     *
+     * @param q - The quaternion
+     * @return The magnitude
+     */
+    static inline float magnitude(const Quaternion &q) {
+        return sqrtf(q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z);
+    }
+
+    /**
+     * Calculate the magnitude of a vector in single precision
+     *
+     * @param v - The vector
+     * @return The magnitude
+     */
+    static inline float magnitude(const VectorFloat &v) {
+        return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    }
+
+    /**
+     * Calculate the magnitude of an integer vector in single precision
+     *
+     * @param v - The vector
+     * @return The magnitude
+     */
+    static inline float magnitude(const VectorInt16 &v) {
+        const float x = v.x, y = v.y, z = v.z;
+        return sqrtf(x * x + y * y + z * z);
+    }
+
+    /**
+     * Normalize a quaternion in place. Nothing is done if it is already unit length within
+     * NORMALIZE_EPSILON, which is the common case for DMP output. Zero quaternions are left
+     * untouched
+     *
+     * @param q - The quaternion to normalize
+     */
+    static inline void normalize(Quaternion &q) {
+        const float squared = q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z;
+        if (fabsf(squared - 1.0f) <= NORMALIZE_EPSILON || squared <= 0.0f) {
+            return;
+        }
+
+        const float scale = refine(invSqrt(squared), squared);
+        q.w *= scale;
+        q.x *= scale;
+        q.y *= scale;
+        q.z *= scale;
+    }
+
+    /**
+     * Normalize a vector in place. Nothing is done if it is already unit length within
+     * NORMALIZE_EPSILON. Zero vectors are left untouched
+     *
+     * @param v - The vector to normalize
+     */
+    static inline void normalize(VectorFloat &v) {
+        const float squared = v.x * v.x + v.y * v.y + v.z * v.z;
+        if (fabsf(squared - 1.0f) <= NORMALIZE_EPSILON || squared <= 0.0f) {
+            return;
+        }
+
+        const float scale = refine(invSqrt(squared), squared);
+        v.x *= scale;
+        v.y *= scale;
+        v.z *= scale;
+    }
+
+    /**
+     * Rotate a vector by a unit quaternion without building any intermediate quaternions:
+     * v' = v + w * t + (q x t) where t = 2 * (q x v). This is 15 multiplies against the 32 of
+     * the two products in VectorFloat::rotate
+     *
+     * @param q - The unit quaternion to rotate by
+     * @param v - The vector to rotate in place
+     */
+    static inline void rotate(const Quaternion &q, VectorFloat &v) { v = getRotated(q, v); }
+
+    /**
+     * Get a vector rotated by a unit quaternion
+     *
+     * @param q - The unit quaternion to rotate by
+     * @param v - The vector to rotate
+     * @return The rotated vector
+     */
+    static constexpr VectorFloat getRotated(const Quaternion &q, const VectorFloat &v) {
+        const float tx = 2.0f * (q.y * v.z - q.z * v.y);
+        const float ty = 2.0f * (q.z * v.x - q.x * v.z);
+        const float tz = 2.0f * (q.x * v.y - q.y * v.x);
+
+        return {v.x + q.w * tx + (q.y * tz - q.z * ty),
+                v.y + q.w * ty + (q.z * tx - q.x * tz),
+                v.z + q.w * tz + (q.x * ty - q.y * tx)};
+    }
+
+    /**
+     * Constexpr sine for building geometry at compile time. The angle is folded into
+     * [-pi/2, pi/2] and evaluated with a degree 11 Taylor polynomial (error < 1e-7). Use
+     * sinf() at runtime
+     *
+     * @param angle - The angle in radians
+     * @return sin(angle)
+     */
+    static constexpr float sinConstexpr(float angle) {
+        // Wrap into [-pi, pi]
+        while (angle > PI_F) {
+            angle -= 2.0f * PI_F;
+        }
+        while (angle < -PI_F) {
+            angle += 2.0f * PI_F;
+        }
+
+        // Fold into [-pi/2, pi/2] with sin(x) = sin(pi - x)
+        if (angle > 0.5f * PI_F) {
+            angle = PI_F - angle;
+        } else if (angle < -0.5f * PI_F) {
+            angle = -PI_F - angle;
+        }
+
+        const float a2 = angle * angle;
+        return angle * (1.0f - a2 / 6.0f * (1.0f - a2 / 20.0f * (1.0f - a2 / 42.0f *
+               (1.0f - a2 / 72.0f * (1.0f - a2 / 110.0f)))));
+    }
+
+    /**
+     * Constexpr cosine for building geometry at compile time. Use cosf() at runtime
+     *
+     * @param angle - The angle in radians
+     * @return cos(angle)
+     */
+    static constexpr float cosConstexpr(float angle) { return sinConstexpr(angle + 0.5f * PI_F); }
+
+private:
+    /**
+     * Apply one more Newton step to a reciprocal square root estimate. Brings invSqrt's error
+     * down to about 5e-6, which keeps repeated normalization from drifting
+     *
+     * @param y - The estimate of 1/sqrt(x)
+     * @param x - The original value
+     * @return The refined estimate
+     */
+    static inline float refine(float y, float x) { return y * (1.5f - 0.5f * x * y * y); }
+};
+
+#endif // FASTMATH_H
@@ -0,0 +1,107 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef MECHANISMGEOMETRY_H
+#define MECHANISMGEOMETRY_H
+
+#include <array>
+#include "control/extendedQuaternion.h"
+
+/**
+ * Fixed geometry of the mechanism, built at compile time from the constexpr quaternion algebra.
+ * Frames: the eyeball frame has z up through the pupil's rest position. The three omni wheels sit
+ * below the equator, evenly spaced about z
+ */
+class MechanismGeometry {
+public:
+    // Constants only
+    MechanismGeometry() = delete;
+
+    // Configuration Variables - set these to match the hardware
+    static constexpr float WHEEL_CONTACT_ANGLE = 45.0f * FastMath::PI_F / 180.0f; // Angle of the
+                                                        // contact points below the equator
+    static constexpr float FIRST_WHEEL_AZIMUTH = 0.0f;  // Azimuth of the first wheel about z
+    static constexpr ExtendedQuaternion IMU_MOUNT{};    // Rotation from the IMU frame to the
+                                                        // eyeball frame
+
+    // Program Variables
+    static constexpr uint8_t WHEEL_COUNT = 3;
+    static constexpr float WHEEL_SPACING = 2.0f * FastMath::PI_F / WHEEL_COUNT;
+
+    /**
+     * Rotation taking the first wheel's frame to wheel i's frame
+     *
+     * @param i - The wheel index
+     * @return The rotation about z
+     */
+    static constexpr ExtendedQuaternion wheelRotation(uint8_t i) {
+        return ExtendedQuaternion::fromAxisAngle({0.0f, 0.0f, 1.0f},
+                                                 FIRST_WHEEL_AZIMUTH + i * WHEEL_SPACING);
+    }
+
+    /**
+     * Unit vector from the eyeball's center to wheel i's contact point
+     *
+     * @param i - The wheel index
+     * @return The contact direction
+     */
+    static constexpr VectorFloat contactDirection(uint8_t i) {
+        return wheelRotation(i).getRotated({FastMath::cosConstexpr(WHEEL_CONTACT_ANGLE), 0.0f,
+                                            -FastMath::sinConstexpr(WHEEL_CONTACT_ANGLE)});
+    }
+
+    /**
+     * Unit direction wheel i drives the eyeball's surface in at its contact point
+     *
+     * @param i - The wheel index
+     * @return The drive direction
+     */
+    static constexpr VectorFloat driveDirection(uint8_t i) {
+        return wheelRotation(i).getRotated({0.0f, 1.0f, 0.0f});
+    }
+
+    /**
+     * Check that two floats are within a tolerance. Used by the compile time checks
+     *
+     * @param a
+     * @param b
+     * @param tolerance - The allowed difference
+     * @return True if |a - b| <= tolerance
+     */
+    static constexpr bool isNear(float a, float b, float tolerance = 1e-5f) {
+        return (a - b <= tolerance) && (b - a <= tolerance);
+    }
+
+    /**
+     * Check the geometry is consistent: unit contact and drive directions that are tangent at
+     * the contact point, and drive directions that cancel out by symmetry
+     *
+     * @return True if the geometry is consistent
+     */
+    static constexpr bool isConsistent() {
+        VectorFloat sum;
+        for (uint8_t i(0); i < WHEEL_COUNT; ++i) {
+            const VectorFloat c = contactDirection(i);
+            const VectorFloat d = driveDirection(i);
+
+            if (!isNear(c.x * c.x + c.y * c.y + c.z * c.z, 1.0f) ||
+                !isNear(d.x * d.x + d.y * d.y + d.z * d.z, 1.0f) ||
+                !isNear(c.x * d.x + c.y * d.y + c.z * d.z, 0.0f)) {
+                return false;
+            }
+
+            sum.x += d.x;
+            sum.y += d.y;
+            sum.z += d.z;
+        }
+
+        return isNear(sum.x, 0.0f) && isNear(sum.y, 0.0f) && isNear(sum.z, 0.0f);
+    }
+};
+
+static_assert(MechanismGeometry::isNear(MechanismGeometry::IMU_MOUNT.squaredNorm(), 1.0f),
+              "IMU_MOUNT must be a unit quaternion");
+static_assert(MechanismGeometry::isConsistent(), "Wheel geometry is inconsistent");
+
+#endif // MECHANISMGEOMETRY_H
@@ -0,0 +1,81 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef ORIENTATION_H
+#define ORIENTATION_H
+
+#include <Arduino.h>
+#include "control/extendedQuaternion.h"
+
+/**
+ * An orientation that caches its rotation matrix. Rotating a vector through the matrix takes 9
+ * multiplies against 15 for the direct quaternion formula, so once more than two vectors are
+ * rotated per update the one-off conversion pays for itself. The cache is built lazily and
+ * invalidated whenever the quaternion is set
+ */
+class Orientation {
+public:
+    /**
+     * Primary constructor - identity orientation
+     */
+    Orientation() = default;
+
+    /**
+     * Secondary constructor - known orientation
+     *
+     * @param q - The unit quaternion
+     */
+    explicit Orientation(const ExtendedQuaternion &q);
+
+    // Default copy-constructor and assignment-op
+    Orientation(const Orientation &) = default;
+
+    Orientation &operator=(const Orientation &) = default;
+
+    /**
+     * Set the orientation and invalidate the cached matrix
+     *
+     * @param q - The unit quaternion
+     */
+    void set(const ExtendedQuaternion &q);
+
+    /**
+     * Get the orientation
+     *
+     * @return The unit quaternion
+     */
+    const ExtendedQuaternion &get() const;
+
+    /**
+     * Get the rotation matrix, building it if the cache is stale
+     *
+     * @return The rotation matrix
+     */
+    const RotationMatrix &getMatrix();
+
+    /**
+     * Rotate a single vector. Uses the cached matrix if it is already valid and the direct
+     * quaternion formula otherwise, so one-off rotations never pay for the conversion
+     *
+     * @param v - The vector to rotate in place
+     */
+    void rotate(VectorFloat &v) const;
+
+    /**
+     * Rotate a batch of vectors through the cached matrix
+     *
+     * @param in - The vectors to rotate
+     * @param out - Where to store the rotated vectors (may alias in)
+     * @param count - The number of vectors
+     */
+    void rotate(const VectorFloat *in, VectorFloat *out, size_t count);
+
+private:
+    // Member variables
+    ExtendedQuaternion quaternion; // The orientation
+    RotationMatrix matrix{};    // Cached rotation matrix of quaternion
+    bool matrixValid = false;   // If matrix matches quaternion
+};
+
+#endif // ORIENTATION_H
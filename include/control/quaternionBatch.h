@@ -0,0 +1,106 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef QUATERNIONBATCH_H
+#define QUATERNIONBATCH_H
+
+#include <cstddef>
+
+/**
+ * Structure-of-arrays view of a batch of quaternions. Each component lives in its own
+ * contiguous array so the kernels can stream through them lane by lane. The view does not own
+ * the memory
+ */
+struct QuaternionArray {
+    float *w;
+    float *x;
+    float *y;
+    float *z;
+};
+
+/**
+ * Structure-of-arrays view of a batch of 3D vectors. The view does not own the memory
+ */
+struct VectorArray {
+    float *x;
+    float *y;
+    float *z;
+};
+
+/**
+ * Batched quaternion kernels over structure-of-arrays data. Each is a plain scalar loop over the
+ * component arrays, as the ESP32 has no SIMD unit to vectorize them with. Outputs may alias inputs
+ */
+class QuaternionBatch {
+public:
+    // Static kernels only
+    QuaternionBatch() = delete;
+
+    /**
+     * Multiply each pair of quaternions: out[i] = lhs[i] * rhs[i]
+     *
+     * @param lhs - The left hand quaternions
+     * @param rhs - The right hand quaternions
+     * @param out - Where to store the products
+     * @param count - The number of quaternions in the batch
+     */
+    static void multiply(const QuaternionArray &lhs, const QuaternionArray &rhs,
+                         const QuaternionArray &out, size_t count);
+
+    /**
+     * Conjugate each quaternion: out[i] = [w, -x, -y, -z]
+     *
+     * @param in - The quaternions to conjugate
+     * @param out - Where to store the conjugates
+     * @param count - The number of quaternions in the batch
+     */
+    static void conjugate(const QuaternionArray &in, const QuaternionArray &out, size_t count);
+
+    /**
+     * Normalize each quaternion in place. Zero quaternions are left untouched
+     *
+     * @param q - The quaternions to normalize
+     * @param count - The number of quaternions in the batch
+     */
+    static void normalize(const QuaternionArray &q, size_t count);
+
+    /**
+     * Rotate each vector by its unit quaternion: out[i] = q[i] * v[i] * conj(q[i])
+     *
+     * @param q - The unit quaternions to rotate by
+     * @param in - The vectors to rotate
+     * @param out - Where to store the rotated vectors
+     * @param count - The number of quaternions in the batch
+     */
+    static void rotate(const QuaternionArray &q, const VectorArray &in, const VectorArray &out,
+                       size_t count);
+
+    /**
+     * Calculate the dot product of each pair of quaternions
+     *
+     * @param lhs - The left hand quaternions
+     * @param rhs - The right hand quaternions
+     * @param out - Where to store the dot products
+     * @param count - The number of quaternions in the batch
+     */
+    static void dot(const QuaternionArray &lhs, const QuaternionArray &rhs, float *out,
+                    size_t count);
+
+    /**
+     * Spherically interpolate each pair of unit quaternions along the shortest arc. Nearly
+     * parallel pairs fall back to a normalized lerp
+     *
+     * https://en.wikipedia.org/wiki/Slerp
+     *
+     * @param from - The quaternions at t = 0
+     * @param to - The quaternions at t = 1
+     * @param t - The interpolation parameter [0, 1]
+     * @param out - Where to store the interpolated quaternions
+     * @param count - The number of quaternions in the batch
+     */
+    static void slerp(const QuaternionArray &from, const QuaternionArray &to, float t,
+                      const QuaternionArray &out, size_t count);
+};
+
+#endif // QUATERNIONBATCH_H
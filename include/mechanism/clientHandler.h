@@ -1,6 +1,6 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 01/30/25
+// Last Modified: 10/18/2026
 
 #ifndef CLIENTHANDLER_H
 #define CLIENTHANDLER_H
@@ -10,6 +10,56 @@
 #include <Arduino.h>
 #include <ArduinoLog.h>
 #include <NimBLEDevice.h>
+#include <nimble/nimble/host/include/host/ble_hs.h>
+#include <nimble/porting/nimble/include/os/os_mbuf.h>
+#include "common/imuProtocol.h"
+#include "common/sampleRing.h"
+#include "common/seqLock.h"
+
+/**
+ * How the client gets IMU samples from the server
+ */
+enum class ImuLink : uint8_t {
+    CONNECTED,  // Connect to the server and have it send samples over the connection
+    BROADCAST   // Sync to the server's periodic advertising train. Needs periodic advertising
+                // enabled in the NimBLE config on both sides
+};
+
+/**
+ * Where the client is in linking to the server. Broadcast links go from SCANNING to SUBSCRIBED
+ * once synced to the train
+ */
+enum class LinkState : uint8_t {
+    IDLE,           // Not initialized
+    SCANNING,       // Looking for a server
+    CONNECTING,     // Opening a connection to serverAddress
+    DISCOVERING,    // Finding the characteristics, negotiating, and subscribing
+    SUBSCRIBED,     // Receiving samples
+    BACKOFF,        // Waiting to scan again after a failure
+    COUNT
+};
+
+/**
+ * What a link event reports
+ */
+enum class LinkEventType : uint8_t {
+    SERVER_FOUND,   // A scan found a server with the service
+    SCAN_ENDED,     // The scan stopped
+    DISCONNECTED,   // The connection dropped
+    SYNCED,         // Synced to a broadcast
+    SYNC_FAILED,    // A broadcast sync could not be established
+    SYNC_LOST       // A broadcast sync was lost
+};
+
+/**
+ * Something the NimBLE host reported, posted from its callbacks to the client's loop. It holds
+ * copies, since what the callback was given may be freed before the loop handles it
+ */
+struct LinkEvent {
+    LinkEventType type = LinkEventType::SCAN_ENDED;
+    ble_addr_t address{};   // The server's address, for SERVER_FOUND
+    int reason = 0;         // The NimBLE reason code, for DISCONNECTED and the sync events
+};
 
 /**
  * A struct to define what to do for client events
@@ -23,7 +73,7 @@ struct ClientCallbacks final : public NimBLEClientCallbacks {
     void onConnect(NimBLEClient *connectedClient) override;
 
     /**
-     * Called for disconnection events. Starts a new scan
+     * Called for disconnection events. Posts DISCONNECTED
      *
      * @param disconnectedClient - The client that disconnected
      * @param reason - The reason for disconnect
@@ -36,20 +86,79 @@ struct ClientCallbacks final : public NimBLEClientCallbacks {
  */
 struct ScanCallbacks final : public NimBLEScanCallbacks {
     /**
-     * Called for each device found during a scan. Checks if it has the correct service UUID
+     * Called for each device found during a scan. Checks if it has the correct service UUID and
+     * posts SERVER_FOUND once per scan, or when broadcast, syncs to its periodic advertising
+     * train
      *
      * @param advertisedDevice - The device that was found
      */
     void onResult(NimBLEAdvertisedDevice *advertisedDevice) override;
 
     /**
-     * Called when a scan ends
+     * Called when a scan ends. Posts SCAN_ENDED
      *
      * @param results - The results of the scan
      */
     void onScanEnd(NimBLEScanResults results) override;
 };
 
+/**
+ * Statistics on the IMU stream, taken from the sequence numbers and timestamps of EXTENDED
+ * packets. The two clocks are not synchronized, so ages are measured from the fastest delivery
+ * seen. They show how much later than the best case each sample arrived. A batched sample is aged
+ * as if it had been sent alone, so the time it waited for its batch is left out
+ */
+struct ImuStreamStats {
+    uint32_t received = 0;      // Packets received
+    uint32_t notifications = 0; // Notifications or broadcasts received (fewer than packets when
+                                // batched)
+    uint32_t lost = 0;          // Sequence numbers that never arrived
+    uint32_t duplicates = 0;    // Packets repeating the previous sequence number
+    uint32_t reordered = 0;     // Packets older than one already received
+    uint32_t lastAge = 0;       // Age of the latest packet in us
+    uint32_t maxAge = 0;        // Largest age seen in us
+    uint64_t totalAge = 0;      // Sum of all ages in us
+    uint32_t aged = 0;          // Packets that carried a timestamp
+    uint32_t ringDropped = 0;   // Packets the full sample ring refused (see nextSample)
+};
+
+/**
+ * An undecoded IMU packet and when it was taken, in the client's clock
+ */
+struct ClientSample {
+    uint32_t time;                      // micros() the sample would have arrived if sent alone
+    uint8_t length;                     // Length of the packet
+    uint8_t packet[MAX_PACKET_SIZE];    // The packet, in the negotiated format
+};
+
+/**
+ * A consistent copy of the latest sample, taken together with when it arrived
+ */
+struct ImuSnapshot {
+    ImuSample sample;       // The decoded sample
+    uint32_t time = 0;      // micros() the sample would have arrived if sent alone
+    uint32_t sequence = 0;  // Samples received up to this one (0 if none). Unchanged means no
+                            // new sample
+};
+
+/**
+ * Decodes the notifications of one characteristic
+ *
+ * @param data - The notification
+ * @param length - The length of the notification
+ */
+using NotifyHandler = void (*)(const uint8_t *data, size_t length);
+
+/**
+ * A subscribed characteristic's attribute handle and the decoder for its notifications
+ */
+struct NotifyRoute {
+    uint16_t handle = 0;                // The characteristic's value handle on the server
+    NotifyHandler handler = nullptr;    // The decoder
+};
+
+constexpr size_t MAX_NOTIFY_ROUTES = 4; // Most characteristics the client can subscribe to
+
 /**
  * A class to handle the BLE Client. It manages its connection to the server and is notified with
  * new data
@@ -76,18 +185,35 @@ public:
     *
     * @param SERVICE_UUID - The service UUID to look for
     * @param IMU_CHARACTERISTIC_UUID - The IMU Characteristic UUID to look for
+    * @param CONTROL_CHARACTERISTIC_UUID - The control Characteristic UUID to look for
+    * @param IMU_FORMAT - The preferred IMU packet format to negotiate
+    * @param IMU_FIELDS - The EXTENDED fields to ask for, if IMU_FORMAT is EXTENDED
+    * @param IMU_BATCH_SIZE - The most samples per notification to ask for (1 is no batching)
+    * @param IMU_BATCH_DELAY - The most ms a sample may wait for its batch
+    * @param IMU_TRANSPORT - The transport to ask for IMU packets on
+    * @param IMU_LINK - Whether to connect to the server or follow its broadcast
+    * @param LATENCY_BUDGET - The most mean sample age in us before the connection interval is
+    * shortened (see ConnectionPolicy)
     * @param DEVICE_NAME - The name of the client's BLE Device
     * @param SCAN_TIME - The duration of a scan in ms (0 is indefinite)
     * @param SCAN_WINDOW - The scan window in ms
     * @param SCAN_INTERVAL - The scan interval in ms
+    * @param RECONNECT_TIMEOUT - The most ms to try the last server's address before scanning
     */
     void initialize(const std::string &SERVICE_UUID, const std::string
-    &IMU_CHARACTERISTIC_UUID, const std::string &DEVICE_NAME, const uint8_t
-                    &SCAN_TIME, const uint32_t &SCAN_WINDOW, const uint32_t &SCAN_INTERVAL);
+    &IMU_CHARACTERISTIC_UUID, const std::string &CONTROL_CHARACTERISTIC_UUID,
+                    const ImuFormat &IMU_FORMAT, const uint8_t &IMU_FIELDS,
+                    const uint8_t &IMU_BATCH_SIZE, const uint8_t &IMU_BATCH_DELAY,
+                    const ImuTransport &IMU_TRANSPORT, const ImuLink &IMU_LINK,
+                    const uint32_t &LATENCY_BUDGET,
+                    const std::string &DEVICE_NAME, const uint8_t &SCAN_TIME,
+                    const uint32_t &SCAN_WINDOW, const uint32_t &SCAN_INTERVAL,
+                    const uint32_t &RECONNECT_TIMEOUT);
 
     /**
-     * Called when a subscribed characteristic notifies the client. It un-packages the IMU's
-     * quaternion data
+     * Called when a subscribed characteristic notifies the client. Finds the characteristic's
+     * decoder by its attribute handle, resolved when it was subscribed, so no UUIDs are compared
+     * per notification
      *
      * @param remoteCharacteristic - The characteristic that notified the client
      * @param data - A ptr to the data received in the notification
@@ -98,21 +224,105 @@ public:
                                size_t length, bool isNotify);
 
     /**
-     * Continuously manage the client's connection to the server
+     * Continuously manage the client's link to the server. It blocks on the event queue, so
+     * events are handled as soon as they are posted, and otherwise only wakes to log statistics,
+     * evaluate the connection, and end a backoff. The link state belongs to one task, so a second
+     * task that calls it logs an error and deletes itself
      */
     [[noreturn]] static void loop();
 
     /**
-     * Get the current quaternion
+     * Post an event to the loop. Called from the NimBLE host's callbacks, so it never blocks. The
+     * last LINK_LOSS_RESERVE slots of the queue are kept for DISCONNECTED and SYNC_LOST, since
+     * dropping one would leave the loop subscribed to a dead link
+     *
+     * @param event - The event
+     */
+    static void post(const LinkEvent &event);
+
+    /**
+     * Get where the client is in linking to the server
+     *
+     * @return The link state
+     */
+    static LinkState getState();
+
+    /**
+     * Get a snapshot of the latest sample. Any task may call this while notifications arrive;
+     * the copy is never half updated and the notifying task never waits for it. The latest packet
+     * is decoded here, by each reader, rather than on every notification
+     *
+     * @param fields - The mask of fields to decode (see ImuField)
+     * @return The snapshot. Fields the server does not send are left out of its field mask
+     */
+    static ImuSnapshot getSnapshot(uint8_t fields = fieldBit(ImuField::QUATERNION));
+
+    /**
+     * Get the current quaternion (see getSnapshot)
+     *
      * @return The current quaternion
      */
-    static const std::array<float, 4> &getQuaternion() ;
+    static std::array<float, 4> getQuaternion();
+
+    /**
+     * Get the current sample with the wanted fields (see getSnapshot)
+     *
+     * @param fields - The mask of fields to decode (see ImuField)
+     * @return The current sample
+     */
+    static ImuSample getSample(uint8_t fields);
+
+    /**
+     * Take the oldest sample from the sample ring, which holds every sample received rather than
+     * just the latest. Each sample's time is when it would have arrived had it been sent alone:
+     * samples in a batch are back-dated by their server timestamps if they have them. The ring
+     * has one consumer, so only one task may take samples
+     *
+     * @param fields - The mask of fields to decode (see ImuField)
+     * @param sample - Where to store the sample
+     * @param time - Where to store the sample's micros() time
+     * @return True if there was a sample
+     */
+    static bool nextSample(uint8_t fields, ImuSample &sample, uint32_t &time);
+
+    /**
+     * Ask the server to switch its DMP output rate and filter profile
+     *
+     * @param profile - The profile to switch to
+     * @return True if the command was written
+     */
+    static bool setProfile(ImuProfile profile);
+
+    /**
+     * Get the IMU stream statistics since the last connection or broadcast sync. Packets without
+     * a sequence number or timestamp are only counted as received. The host task updates them,
+     * so this copies the snapshot it publishes after each notification
+     *
+     * @return A consistent copy of the statistics
+     */
+    static ImuStreamStats getStats();
+
+    /**
+     * Clear the IMU stream statistics. Called on every connection and broadcast sync, since a new
+     * server starts its sequence numbers and clock over. Any task may call it; the host task
+     * clears them before counting its next notification
+     */
+    static void resetStats();
+
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+    /**
+     * Sync to a server's periodic advertising train, unless a sync is already pending
+     *
+     * @param server - The server's broadcast advertising set
+     */
+    static void syncToBroadcast(const NimBLEAdvertisedDevice *server);
+#endif
 
     // Public Member variables - used by the callbacks
-    static NimBLEAdvertisedDevice *advDevice;   // A ptr to a device with the correct UUID
-    static std::string serviceUUID; // The service UUID to look for
-    static uint32_t scanTime; // The duration of a scan in ms (0 is indefinite)
-    static bool doConnect;  // If the client should try to connect to a device
+    static NimBLEUUID serviceID;    // The service UUID to look for, parsed once rather than per
+                                    // advertiser
+    static ImuLink link;    // Whether to connect to the server or follow its broadcast
+    static std::atomic<bool> serverFound;   // If this scan already posted SERVER_FOUND
 
 private:
     /**
@@ -121,20 +331,187 @@ private:
     ClientHandler() = default;
 
     /**
-     * Attempts to connect to a server with the correct service UUID. It then checks its
-     * characteristic's properties and subscribes to notifications.
+     * Act on an event from the callbacks. Events that no longer fit the state, such as scan
+     * results queued before the scan stopped, are ignored
      *
+     * @param event - The event
+     */
+    static void handleEvent(const LinkEvent &event);
+
+    /**
+     * Move to a link state. The time spent in each state is added up while linking and logged
+     * when the link is made
+     *
+     * @param next - The state to move to
+     */
+    static void setState(LinkState next);
+
+    /**
+     * Start scanning for a server
+     */
+    static void startScan();
+
+    /**
+     * Wait before scanning again. The wait doubles with each failure until a link is made
+     */
+    static void enterBackoff();
+
+    /**
+     * Connect to serverAddress, then discover and subscribe. A direct attempt is a reconnect to
+     * the last server after a drop, which only gets the reconnect timeout and falls back to
+     * scanning. Other failures back off
+     *
+     * @param direct - If the address is the last server's rather than a scan result
+     */
+    static void linkToServer(bool direct);
+
+    /**
+     * Connect to serverAddress, reusing the client from the last connection to it if there is one
+     *
+     * @param timeout - The most ms to wait for the connection
+     * @return The connected client (null if it failed)
+     */
+    static NimBLEClient *connectToServer(uint32_t timeout);
+
+    /**
+     * Find the server's characteristics, check their properties, negotiate the format, and
+     * subscribe to notifications
+     *
+     * @param client - The connected client
      * @return True if successful
      */
-    static bool connectToServer();
+    static bool discoverServer(NimBLEClient *client);
+
+    /**
+     * Negotiate the IMU packet format with the server through its control characteristic.
+     * Servers without one only send the legacy format
+     *
+     * @param remoteControlCharacteristic - The server's control characteristic (may be null)
+     */
+    static void negotiateFormat(NimBLERemoteCharacteristic *remoteControlCharacteristic);
+
+    /**
+     * Subscribe to a characteristic's notifications and route them to a decoder
+     *
+     * @param characteristic - The characteristic
+     * @param handler - The decoder for its notifications
+     * @return True if subscribed
+     */
+    static bool subscribe(NimBLERemoteCharacteristic *characteristic, NotifyHandler handler);
+
+    /**
+     * Decode an IMU notification. It validates the packet and unpacks batches, storing each
+     * packet in the sample ring and publishing the newest as the latest packet. Decoding waits
+     * until a packet is read
+     *
+     * @param data - The notification
+     * @param length - The length of the notification
+     */
+    static void handleIMUNotification(const uint8_t *data, size_t length);
+
+    /**
+     * Called for events on the L2CAP channel the server opens. Each SDU received is handled as an
+     * IMU notification
+     *
+     * @param event - The event
+     * @param arg - Unused
+     * @return 0 to accept the channel, as NimBLE expects
+     */
+    static int l2capEvent(ble_l2cap_event *event, void *arg);
+
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+    /**
+     * Called for events on the periodic advertising sync. Each complete report is handled as a
+     * broadcast, and the scan restarts if the sync is lost
+     *
+     * @param event - The event
+     * @param arg - Unused
+     * @return 0, as NimBLE expects
+     */
+    static int syncEvent(ble_gap_event *event, void *arg);
+
+    /**
+     * Decode a periodic advertisement. It finds the IMU batch in the manufacturer data and stores
+     * the packets newer than those already received, as handleIMUNotification does
+     *
+     * @param data - The advertising data
+     * @param length - The length of the advertising data
+     */
+    static void handleBroadcast(const uint8_t *data, size_t length);
+#endif
+
+    /**
+     * Store a single packet as the latest packet and in the sample ring, and count it in the
+     * stream statistics
+     *
+     * @param data - The packet
+     * @param length - The length of the packet
+     * @param receiveTime - micros() when the notification arrived
+     * @param newestTimestamp - The server timestamp of the newest packet in the notification
+     */
+    static void storePacket(const uint8_t *data, size_t length, uint32_t receiveTime,
+                            uint32_t newestTimestamp);
+
+    /**
+     * Update the stream statistics with a packet's sequence number and timestamp
+     *
+     * @param header - The packet's SEQUENCE and TIMESTAMP fields
+     * @param receiveTime - micros() when the packet would have arrived had it been sent alone
+     */
+    static void updateStats(const ImuSample &header, uint32_t receiveTime);
+
+    /**
+     * Count a notification or broadcast, first clearing the statistics if resetStats asked to
+     */
+    static void countNotification();
 
     // Member Variables
     static ClientHandler *inst; // Ptr to the singleton inst
+    static std::string serviceUUID; // The service UUID to look for
+    static uint32_t scanTime; // The duration of a scan in ms (0 is indefinite)
+    static NimBLEAddress serverAddress; // The address of the server to connect to (null until
+                                        // a scan finds one)
     static ClientCallbacks clientCallback; // Client callback instance
     static ScanCallbacks scanCallback; // Scan callback instance
     static bool initialized;    // Initialization flag
     static std::string IMUCharacteristicUUID;  // The IMU Characteristic UUID
-    static std::array<float, 4> quaternion; // Quaternion container : w, x, y, z
+    static std::string controlCharacteristicUUID;  // The control Characteristic UUID
+    static ImuFormat preferredFormat;   // The IMU packet format to ask the server for
+    static uint8_t preferredFields;     // The EXTENDED fields to ask the server for
+    static ImuTransport preferredTransport; // The transport to ask the server for
+    static uint8_t batchSize;   // The most samples per notification to ask the server for
+    static uint8_t batchDelay;  // The most ms a sample may wait for its batch
+    static NimBLERemoteCharacteristic *remoteControlCharacteristic; // The server's control
+                                                                    // characteristic (may be null)
+    static std::array<NotifyRoute, MAX_NOTIFY_ROUTES> notifyRoutes; // Decoders of the
+                                                                    // subscribed characteristics
+    static size_t notifyRouteCount; // Number of routes in notifyRoutes
+    static SeqLock<ClientSample> latest;    // Latest undecoded IMU packet, shared with readers
+    static SampleRing<ClientSample, 32> sampleRing; // Every packet received, oldest first
+    static ImuStreamStats stats;    // IMU stream statistics since the last connection, owned by
+                                    // the host task
+    static SeqLock<ImuStreamStats> publishedStats;  // Copy of stats for the other tasks
+    static std::atomic<bool> statsResetRequested;   // If stats should be cleared before the next
+                                                    // notification is counted
+    static uint16_t lastSequence;   // The newest sequence number received
+    static bool hasSequence;    // If lastSequence is valid
+    static int32_t ageFloor;    // The smallest receive time - timestamp seen, in us
+    static bool hasAgeFloor;    // If ageFloor is valid
+    static uint32_t reconnectTimeout;   // The most ms to try the last server before scanning
+    static QueueHandle_t events;    // Events posted by the callbacks, oldest first
+    static LinkState state;         // Where the client is in linking, owned by the loop
+    static std::array<uint32_t, static_cast<size_t>(LinkState::COUNT)> phaseTimes; // ms spent in
+                                                        // each state since the link was lost
+    static uint32_t phaseStart;     // millis() the current state was entered
+    static uint32_t backoff;        // ms the next backoff waits
+    static uint32_t backoffEnd;     // millis() the current backoff ends
+    static uint32_t linkLostTime;   // micros() the link drop was detected
+    static bool awaitingSample;     // If no sample arrived since the link dropped
+    static bool directReconnect;    // If the link came back without a scan
+    static std::atomic<TaskHandle_t> loopTask;  // The task running loop() (null until it starts)
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+    static bool syncPending;    // If a sync was requested or established
+#endif
 };
 
 #endif // CLIENTHANDLER_H
\ No newline at end of file
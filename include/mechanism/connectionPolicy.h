@@ -0,0 +1,91 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef CONNECTIONPOLICY_H
+#define CONNECTIONPOLICY_H
+
+//#define DISABLE_LOGGING
+
+#include <Arduino.h>
+#include <ArduinoLog.h>
+#include <NimBLEDevice.h>
+#include "mechanism/clientHandler.h"
+
+/**
+ * Chooses the client's connection parameters from the IMU stream. The server can send one
+ * notification per connection event without queueing, so the interval follows the measured time
+ * between notifications. It is shortened further while samples arrive later than the latency
+ * budget, and lengthened back once they are well within it. On connecting it also asks for the 2M
+ * PHY and the largest data length, so batches go out in one packet. Controllers that lack them
+ * keep the 1M PHY and 27 byte packets
+ */
+class ConnectionPolicy {
+public:
+    // Static methods only
+    ConnectionPolicy() = delete;
+
+    /**
+     * Set the latency budget
+     *
+     * @param latencyBudget - The most mean sample age in us before the interval is shortened
+     */
+    static void initialize(uint32_t latencyBudget);
+
+    /**
+     * Set the parameters a client connects with. The stream rate is not known yet, so this is
+     * the shortest interval
+     *
+     * @param client - The client about to connect
+     */
+    static void setConnectParams(NimBLEClient *client);
+
+    /**
+     * Called when the client connects. Requests the 2M PHY and data length extension, and starts
+     * measuring the stream
+     *
+     * @param client - The connected client
+     */
+    static void onConnect(NimBLEClient *client);
+
+    /**
+     * Called when the client disconnects
+     */
+    static void onDisconnect();
+
+    /**
+     * Called when the stream is about to change rate, such as on a profile change. Returns to the
+     * shortest interval until the new rate is measured
+     */
+    static void restart();
+
+    /**
+     * Measure the stream since the last call and renegotiate the interval if it no longer fits.
+     * Does nothing until a full measurement window has passed, so it may be called every loop
+     *
+     * @param stats - The IMU stream statistics
+     */
+    static void evaluate(const ImuStreamStats &stats);
+
+private:
+    /**
+     * Ask the server for a connection interval
+     *
+     * @param interval - The interval in 1.25 ms units
+     */
+    static void request(uint16_t interval);
+
+    // Member Variables
+    static NimBLEClient *client;    // The connected client (null while disconnected)
+    static uint32_t latencyBudget;  // The most mean sample age in us before shortening
+    static uint16_t requested;      // The interval last requested in 1.25 ms units
+    static uint16_t latencyCap;     // The longest interval the latency allows in 1.25 ms units
+    static uint16_t achieved;       // The interval last logged in 1.25 ms units
+    static bool restarting;         // If the next evaluation only starts a new window
+    static uint32_t windowStart;    // millis() the measurement window started
+    static uint32_t windowNotifications;    // stats.notifications when the window started
+    static uint32_t windowAged;     // stats.aged when the window started
+    static uint64_t windowTotalAge; // stats.totalAge when the window started
+};
+
+#endif // CONNECTIONPOLICY_H
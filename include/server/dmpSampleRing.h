@@ -0,0 +1,28 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef DMPSAMPLERING_H
+#define DMPSAMPLERING_H
+
+#include <Arduino.h>
+#include "common/sampleRing.h"
+
+constexpr uint16_t DMP_PACKET_SIZE = 42;    // Size of a MotionApps20 FIFO packet
+
+/**
+ * A DMP FIFO packet, when it was taken, and its place in the stream
+ */
+struct DmpSample {
+    uint32_t timestamp;                 // micros() when the IMU produced the packet
+    uint16_t sequence;                  // Counts every packet read, including any the ring refused
+    uint8_t packet[DMP_PACKET_SIZE];    // The raw DMP packet
+};
+
+/**
+ * The ring between the task reading the IMU (producer) and the task transmitting its samples
+ * (consumer)
+ */
+using DmpSampleRing = SampleRing<DmpSample, 32>;
+
+#endif // DMPSAMPLERING_H
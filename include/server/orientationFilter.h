@@ -0,0 +1,87 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#ifndef ORIENTATIONFILTER_H
+#define ORIENTATIONFILTER_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * A 6-axis orientation filter for raw gyro and accelerometer samples, used in place of the DMP
+ * when a faster output rate is wanted. It runs either Madgwick's gradient descent filter or
+ * Mahony's complementary filter. Everything is single precision so it stays on the ESP32's FPU,
+ * and vectors are normalized with the fast inverse square root
+ *
+ * Like the DMP, there is no magnetometer, so yaw is integrated from the gyro and drifts with its
+ * residual bias
+ */
+class OrientationFilter {
+public:
+    /**
+     * The filter algorithms
+     */
+    enum class Type : uint8_t {
+        MADGWICK,   // Gradient descent on the gravity error, one gain (beta)
+        MAHONY      // PI feedback on the gravity error, which also tracks gyro bias
+    };
+
+    /**
+     * Primary constructor
+     *
+     * @param type - The algorithm to run
+     * @param proportionalGain - Madgwick's beta or Mahony's Kp. Higher trusts the accelerometer
+     *                           more
+     * @param integralGain - Mahony's Ki (unused by Madgwick)
+     */
+    OrientationFilter(Type type, float proportionalGain, float integralGain = 0.0f);
+
+    /**
+     * Integrate one sample
+     *
+     * @param gx, gy, gz - Body rates in rad/s
+     * @param ax, ay, az - Acceleration in any consistent unit. Ignored if all zero
+     * @param dt - Time since the previous sample in s
+     */
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+
+    /**
+     * Reset to the identity orientation and clear Mahony's bias estimate
+     */
+    void reset();
+
+    /**
+     * Get the current orientation
+     *
+     * @return The unit quaternion {w, x, y, z}
+     */
+    const std::array<float, 4> &getQuaternion() const { return q; }
+
+private:
+    /**
+     * Madgwick's update. The accelerometer step is the normalized gradient of the error between
+     * measured and predicted gravity, subtracted from the gyro rate at beta
+     */
+    void updateMadgwick(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+
+    /**
+     * Mahony's update. The cross product of measured and predicted gravity is fed back into the
+     * gyro rate through a PI controller
+     */
+    void updateMahony(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+
+    /**
+     * Integrate a body rate quaternion derivative and renormalize
+     */
+    void integrate(float qDotW, float qDotX, float qDotY, float qDotZ, float dt);
+
+    // Member variables
+    Type type;
+    float proportionalGain;
+    float integralGain;
+    std::array<float, 4> q{1.0f, 0.0f, 0.0f, 0.0f}; // w, x, y, z
+    std::array<float, 3> integralError{};           // Mahony's gyro bias estimate in rad/s
+};
+
+#endif // ORIENTATIONFILTER_H
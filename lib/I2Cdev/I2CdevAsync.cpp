@@ -0,0 +1,97 @@
+// I2Cdev library collection - Asynchronous ESP-IDF transaction backend
+// 2026-10-18 by Robert Polk
+//
+// Changelog:
+//      2026-10-18 - initial release
+//      2026-10-18 - worker task can be pinned to a core
+//      2026-10-18 - worker stack size is configurable and its headroom can be read
+
+#include "I2CdevAsync.h"
+
+#if defined(ESP32)
+
+uint32_t I2CdevAsync::timeout = 20;
+i2c_port_t I2CdevAsync::port = I2C_NUM_0;
+QueueHandle_t I2CdevAsync::queue = nullptr;
+TaskHandle_t I2CdevAsync::workerTask = nullptr;
+
+bool I2CdevAsync::begin(i2c_port_t i2cPort, UBaseType_t priority, uint8_t queueLength, BaseType_t core, uint32_t stackSize) {
+    if (queue != nullptr) return true;
+
+    port = i2cPort;
+    queue = xQueueCreate(queueLength, sizeof(Request));
+    if (queue == nullptr) return false;
+
+    if (xTaskCreatePinnedToCore(worker, "I2CdevAsync", stackSize, nullptr, priority, &workerTask, core) != pdPASS) {
+        vQueueDelete(queue);
+        queue = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool I2CdevAsync::readBytes(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, Callback callback, void *arg) {
+    return submit({devAddr, regAddr, true, length, data, callback, arg, nullptr});
+}
+
+bool I2CdevAsync::readBytes(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, TaskHandle_t task) {
+    return submit({devAddr, regAddr, true, length, data, nullptr, nullptr, task});
+}
+
+bool I2CdevAsync::writeBytes(uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t *data, Callback callback, void *arg) {
+    // The worker never writes through data for a write, so dropping const is safe
+    return submit({devAddr, regAddr, false, length, const_cast<uint8_t *>(data), callback, arg, nullptr});
+}
+
+UBaseType_t I2CdevAsync::pending() {
+    return queue == nullptr ? 0 : uxQueueMessagesWaiting(queue);
+}
+
+UBaseType_t I2CdevAsync::stackHeadroom() {
+    return workerTask == nullptr ? 0 : uxTaskGetStackHighWaterMark(workerTask);
+}
+
+bool I2CdevAsync::submit(const Request &request) {
+    if (queue == nullptr || request.length == 0) return false;
+    return xQueueSend(queue, &request, 0) == pdPASS;
+}
+
+esp_err_t I2CdevAsync::run(const Request &request) {
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    if (cmd == nullptr) return ESP_ERR_NO_MEM;
+
+    // [S][addr+W][reg] then either [data...][P] or [Sr][addr+R][data...][P]
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (request.devAddr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, request.regAddr, true);
+    if (request.read) {
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (request.devAddr << 1) | I2C_MASTER_READ, true);
+        i2c_master_read(cmd, request.data, request.length, I2C_MASTER_LAST_NACK);
+    } else {
+        i2c_master_write(cmd, request.data, request.length, true);
+    }
+    i2c_master_stop(cmd);
+
+    const esp_err_t result = i2c_master_cmd_begin(port, cmd, pdMS_TO_TICKS(timeout));
+    i2c_cmd_link_delete(cmd);
+    return result;
+}
+
+void I2CdevAsync::worker(void *param) {
+    Request request;
+
+    while (true) {
+        if (xQueueReceive(queue, &request, portMAX_DELAY) != pdPASS) continue;
+
+        const esp_err_t result = run(request);
+        if (request.callback != nullptr) {
+            request.callback(result, request.arg);
+        }
+        if (request.task != nullptr) {
+            xTaskNotify(request.task, static_cast<uint32_t>(result), eSetValueWithOverwrite);
+        }
+    }
+}
+
+#endif // ESP32
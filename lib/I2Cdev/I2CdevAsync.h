@@ -0,0 +1,155 @@
+// I2Cdev library collection - Asynchronous ESP-IDF transaction backend header file
+// Queues I2C transactions to a worker task so the caller is free while they are on the bus
+// 2026-10-18 by Robert Polk
+//
+// Changelog:
+//      2026-10-18 - initial release
+//      2026-10-18 - worker task can be pinned to a core
+//      2026-10-18 - worker stack size is configurable and its headroom can be read
+
+#ifndef _I2CDEV_ASYNC_H_
+#define _I2CDEV_ASYNC_H_
+
+#if defined(ESP32)
+
+#include <Arduino.h>
+#include <driver/i2c.h>
+
+/**
+ * Runs I2C transactions on the ESP-IDF I2C master driver from a worker task. Callers submit a
+ * read or write and return immediately; the worker signals completion by callback or by task
+ * notification. The driver serializes each command link with its own lock, so transactions from
+ * here and from Wire/I2Cdev on the same port never interleave on the bus.
+ *
+ * The driver must already be installed on the port, which Wire.begin() does for I2C_NUM_0.
+ * Buffers must stay valid until the transaction completes.
+ */
+class I2CdevAsync {
+    public:
+        /**
+         * Completion callback, called from the worker task
+         *
+         * @param result - ESP_OK or the driver's error code
+         * @param arg - The argument given when the transaction was submitted
+         */
+        typedef void (*Callback)(esp_err_t result, void *arg);
+
+        I2CdevAsync() = delete;
+
+        /**
+         * Start the worker task
+         *
+         * @param port - The I2C port, which must already have the driver installed
+         * @param priority - The worker task priority
+         * @param queueLength - The number of transactions that can wait
+         * @param core - The core to pin the worker to (tskNO_AFFINITY to let it float)
+         * @param stackSize - Bytes of stack for the worker. Check stackHeadroom() under load
+         *                    before shrinking it
+         * @return True if the worker started (or was already running)
+         */
+        static bool begin(i2c_port_t port = I2C_NUM_0, UBaseType_t priority = 3, uint8_t queueLength = 4, BaseType_t core = tskNO_AFFINITY, uint32_t stackSize = DEFAULT_STACK_SIZE);
+
+        /**
+         * Queue a register read
+         *
+         * @param devAddr - The 7 bit device address
+         * @param regAddr - The register to read from
+         * @param length - The number of bytes to read
+         * @param data - Where to store the bytes
+         * @param callback - Called when the read completes (may be nullptr)
+         * @param arg - Passed to callback
+         * @return True if the read was queued
+         */
+        static bool readBytes(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, Callback callback, void *arg = nullptr);
+
+        /**
+         * Queue a register read that notifies a task when it completes. The task receives the
+         * result in its notification value (ESP_OK on success)
+         *
+         * @param devAddr - The 7 bit device address
+         * @param regAddr - The register to read from
+         * @param length - The number of bytes to read
+         * @param data - Where to store the bytes
+         * @param task - The task to notify
+         * @return True if the read was queued
+         */
+        static bool readBytes(uint8_t devAddr, uint8_t regAddr, uint16_t length, uint8_t *data, TaskHandle_t task);
+
+        /**
+         * Queue a register write
+         *
+         * @param devAddr - The 7 bit device address
+         * @param regAddr - The register to write to
+         * @param length - The number of bytes to write
+         * @param data - The bytes to write
+         * @param callback - Called when the write completes (may be nullptr)
+         * @param arg - Passed to callback
+         * @return True if the write was queued
+         */
+        static bool writeBytes(uint8_t devAddr, uint8_t regAddr, uint16_t length, const uint8_t *data, Callback callback, void *arg = nullptr);
+
+        /**
+         * Get the number of transactions waiting for the worker
+         *
+         * @return The number of transactions
+         */
+        static UBaseType_t pending();
+
+        /**
+         * Get the least stack the worker has had free since it started. The worker's own frame
+         * is small, so this is mostly the driver's i2c_master_cmd_begin and the callbacks
+         *
+         * @return The stack high-water mark in bytes (0 if the worker is not running)
+         */
+        static UBaseType_t stackHeadroom();
+
+        static constexpr uint32_t DEFAULT_STACK_SIZE = 2048; // Bytes of worker stack
+
+        static uint32_t timeout;    // Max ms a transaction may hold the bus
+
+    private:
+        /**
+         * A queued transaction
+         */
+        struct Request {
+            uint8_t devAddr;
+            uint8_t regAddr;
+            bool read;
+            uint16_t length;
+            uint8_t *data;
+            Callback callback;
+            void *arg;
+            TaskHandle_t task;
+        };
+
+        /**
+         * Queue a transaction
+         *
+         * @param request - The transaction
+         * @return True if it was queued
+         */
+        static bool submit(const Request &request);
+
+        /**
+         * Run one transaction on the bus
+         *
+         * @param request - The transaction
+         * @return ESP_OK or the driver's error code
+         */
+        static esp_err_t run(const Request &request);
+
+        /**
+         * The worker task. Runs queued transactions in order and signals each one's completion
+         *
+         * @param param - Unused
+         */
+        [[noreturn]] static void worker(void *param);
+
+        static i2c_port_t port;
+        static QueueHandle_t queue;
+        static TaskHandle_t workerTask;
+};
+
+#endif // ESP32
+
+#endif /* _I2CDEV_ASYNC_H_ */
@@ -4,6 +4,8 @@
 // Updates should (hopefully) always be available at https://github.com/jrowberg/i2cdevlib
 //
 // Changelog:
+//  2026-10-18 - spot verification reads back a few bytes per bank instead of whole chunks
+//  2026-10-18 - allocation-free DMP loader with Wire-sized chunks and spot verification
 //  2021-09-27 - split implementations out of header files, finally
 //  2019-07-08 - Added Auto Calibration routine
 //     ... - ongoing debug release
@@ -3100,57 +3102,39 @@ bool MPU6050_Base::writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint
     setMemoryBank(bank);
     setMemoryStartAddress(address);
     uint8_t chunkSize;
-    uint8_t *verifyBuffer=0;
-    uint8_t *progBuffer=0;
+    uint8_t progBuffer[MPU6050_DMP_LOAD_CHUNK_SIZE];    // no heap: chunks are bounded
+    uint8_t verifyBuffer[MPU6050_DMP_LOAD_CHUNK_SIZE];
+    const uint8_t *chunk;
     uint16_t i;
     uint8_t j;
-    if (verify) verifyBuffer = (uint8_t *)malloc(MPU6050_DMP_MEMORY_CHUNK_SIZE);
-    if (useProgMem) progBuffer = (uint8_t *)malloc(MPU6050_DMP_MEMORY_CHUNK_SIZE);
     for (i = 0; i < dataSize;) {
         // determine correct chunk size according to bank position and data size
-        chunkSize = MPU6050_DMP_MEMORY_CHUNK_SIZE;
+        chunkSize = MPU6050_DMP_LOAD_CHUNK_SIZE;
 
         // make sure we don't go past the data size
         if (i + chunkSize > dataSize) chunkSize = dataSize - i;
 
         // make sure this chunk doesn't go past the bank boundary (256 bytes)
         if (chunkSize > 256 - address) chunkSize = 256 - address;
-        
+
         if (useProgMem) {
             // write the chunk of data as specified
             for (j = 0; j < chunkSize; j++) progBuffer[j] = pgm_read_byte(data + i + j);
+            chunk = progBuffer;
         } else {
             // write the chunk of data as specified
-            progBuffer = (uint8_t *)data + i;
+            chunk = data + i;
         }
 
-        I2Cdev::writeBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, progBuffer, wireObj);
+        I2Cdev::writeBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, (uint8_t *)chunk, wireObj);
 
-        // verify data if needed
-        if (verify && verifyBuffer) {
+        // verify data if needed: every chunk, or a few bytes at the start of the block and of each bank
+        if (verify && (MPU6050_DMP_VERIFY_MODE == MPU6050_DMP_VERIFY_FULL || i == 0 || address == 0)) {
+            const uint8_t verifySize = MPU6050_DMP_VERIFY_MODE == MPU6050_DMP_VERIFY_FULL ? chunkSize : (chunkSize < MPU6050_DMP_VERIFY_SPOT_SIZE ? chunkSize : MPU6050_DMP_VERIFY_SPOT_SIZE);
             setMemoryBank(bank);
             setMemoryStartAddress(address);
-            I2Cdev::readBytes(devAddr, MPU6050_RA_MEM_R_W, chunkSize, verifyBuffer, I2Cdev::readTimeout, wireObj);
-            if (memcmp(progBuffer, verifyBuffer, chunkSize) != 0) {
-                /*Serial.print("Block write verification error, bank ");
-                Serial.print(bank, DEC);
-                Serial.print(", address ");
-                Serial.print(address, DEC);
-                Serial.print("!\nExpected:");
-                for (j = 0; j < chunkSize; j++) {
-                    Serial.print(" 0x");
-                    if (progBuffer[j] < 16) Serial.print("0");
-                    Serial.print(progBuffer[j], HEX);
-                }
-                Serial.print("\nReceived:");
-                for (uint8_t j = 0; j < chunkSize; j++) {
-                    Serial.print(" 0x");
-                    if (verifyBuffer[i + j] < 16) Serial.print("0");
-                    Serial.print(verifyBuffer[i + j], HEX);
-                }
-                Serial.print("\n");*/
-                free(verifyBuffer);
-                if (useProgMem) free(progBuffer);
+            I2Cdev::readBytes(devAddr, MPU6050_RA_MEM_R_W, verifySize, verifyBuffer, I2Cdev::readTimeout, wireObj);
+            if (memcmp(chunk, verifyBuffer, verifySize) != 0) {
                 return false; // uh oh.
             }
         }
@@ -3168,20 +3152,14 @@ bool MPU6050_Base::writeMemoryBlock(const uint8_t *data, uint16_t dataSize, uint
             setMemoryStartAddress(address);
         }
     }
-    if (verify) free(verifyBuffer);
-    if (useProgMem) free(progBuffer);
     return true;
 }
 bool MPU6050_Base::writeProgMemoryBlock(const uint8_t *data, uint16_t dataSize, uint8_t bank, uint8_t address, bool verify) {
     return writeMemoryBlock(data, dataSize, bank, address, verify, true);
 }
 bool MPU6050_Base::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSize, bool useProgMem) {
-    uint8_t *progBuffer = 0;
 	uint8_t success, special;
-    uint16_t i, j;
-    if (useProgMem) {
-        progBuffer = (uint8_t *)malloc(8); // assume 8-byte blocks, realloc later if necessary
-    }
+    uint16_t i;
 
     // config set data is a long string of blocks with the following structure:
     // [bank] [offset] [length] [byte[0], byte[1], ..., byte[length]]
@@ -3206,13 +3184,8 @@ bool MPU6050_Base::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSi
             Serial.print(offset);
             Serial.print(", length=");
             Serial.println(length);*/
-            if (useProgMem) {
-                if (sizeof(progBuffer) < length) progBuffer = (uint8_t *)realloc(progBuffer, length);
-                for (j = 0; j < length; j++) progBuffer[j] = pgm_read_byte(data + i + j);
-            } else {
-                progBuffer = (uint8_t *)data + i;
-            }
-            success = writeMemoryBlock(progBuffer, length, bank, offset, true);
+            // writeMemoryBlock reads program memory a chunk at a time itself
+            success = writeMemoryBlock(data + i, length, bank, offset, true, useProgMem);
             i += length;
         } else {
             // special instruction
@@ -3244,11 +3217,9 @@ bool MPU6050_Base::writeDMPConfigurationSet(const uint8_t *data, uint16_t dataSi
         }
         
         if (!success) {
-            if (useProgMem) free(progBuffer);
             return false; // uh oh
         }
     }
-    if (useProgMem) free(progBuffer);
     return true;
 }
 bool MPU6050_Base::writeProgDMPConfigurationSet(const uint8_t *data, uint16_t dataSize) {
@@ -4,6 +4,7 @@
 // Updates should (hopefully) always be available at https://github.com/jrowberg/i2cdevlib
 //
 // Changelog:
+//  2026/10/18 - allocation-free DMP loader with Wire-sized chunks and spot verification
 //  2021/09/27 - split implementations out of header files, finally
 //     ... - ongoing debug release
 
@@ -435,6 +436,28 @@ THE SOFTWARE.
 #define MPU6050_DMP_MEMORY_BANK_SIZE    256
 #define MPU6050_DMP_MEMORY_CHUNK_SIZE   16
 
+// Largest DMP memory write. The Wire buffer also holds the register address, and I2Cdev lengths
+// are 8 bit. Writes never cross a bank, so any size up to the bank size is valid
+#ifndef MPU6050_DMP_LOAD_CHUNK_SIZE
+    #if I2CDEVLIB_WIRE_BUFFER_LENGTH - 1 < 255
+        #define MPU6050_DMP_LOAD_CHUNK_SIZE (I2CDEVLIB_WIRE_BUFFER_LENGTH - 1)
+    #else
+        #define MPU6050_DMP_LOAD_CHUNK_SIZE 255
+    #endif
+#endif
+
+// How writeMemoryBlock checks writes when verify is set: read back every chunk, or only the first
+// MPU6050_DMP_VERIFY_SPOT_SIZE bytes of each block and of each bank it reaches. Spot checking the
+// 3 KB MotionApps20 image reads back 12 banks x 8 bytes, about 100 bytes against the whole image
+#define MPU6050_DMP_VERIFY_FULL         0
+#define MPU6050_DMP_VERIFY_SPOT         1
+#ifndef MPU6050_DMP_VERIFY_MODE
+    #define MPU6050_DMP_VERIFY_MODE     MPU6050_DMP_VERIFY_SPOT
+#endif
+#ifndef MPU6050_DMP_VERIFY_SPOT_SIZE
+    #define MPU6050_DMP_VERIFY_SPOT_SIZE 8
+#endif
+
 #define MPU6050_FIFO_DEFAULT_TIMEOUT 11000
 
 class MPU6050_Base {
@@ -39,19 +39,9 @@ class Quaternion {
         float y;
         float z;
         
-        Quaternion() {
-            w = 1.0f;
-            x = 0.0f;
-            y = 0.0f;
-            z = 0.0f;
-        }
+        constexpr Quaternion() : w(1.0f), x(0.0f), y(0.0f), z(0.0f) {}
         
-        Quaternion(float nw, float nx, float ny, float nz) {
-            w = nw;
-            x = nx;
-            y = ny;
-            z = nz;
-        }
+        constexpr Quaternion(float nw, float nx, float ny, float nz) : w(nw), x(nx), y(ny), z(nz) {}
 
         Quaternion getProduct(Quaternion q) {
             // Quaternion multiplication is defined by:
@@ -95,17 +85,9 @@ class VectorInt16 {
         int16_t y;
         int16_t z;
 
-        VectorInt16() {
-            x = 0;
-            y = 0;
-            z = 0;
-        }
+        constexpr VectorInt16() : x(0), y(0), z(0) {}
         
-        VectorInt16(int16_t nx, int16_t ny, int16_t nz) {
-            x = nx;
-            y = ny;
-            z = nz;
-        }
+        constexpr VectorInt16(int16_t nx, int16_t ny, int16_t nz) : x(nx), y(ny), z(nz) {}
 
         float getMagnitude() {
             return sqrt(x*x + y*y + z*z);
@@ -162,17 +144,9 @@ class VectorFloat {
         float y;
         float z;
 
-        VectorFloat() {
-            x = 0;
-            y = 0;
-            z = 0;
-        }
+        constexpr VectorFloat() : x(0), y(0), z(0) {}
         
-        VectorFloat(float nx, float ny, float nz) {
-            x = nx;
-            y = ny;
-            z = nz;
-        }
+        constexpr VectorFloat(float nx, float ny, float nz) : x(nx), y(ny), z(nz) {}
 
         float getMagnitude() {
             return sqrt(x*x + y*y + z*z);
@@ -260,7 +260,7 @@
 #define CONFIG_BT_NIMBLE_HCI_EVT_LO_BUF_COUNT 8
 
 /** @brief Maximum number of connection oriented channels */
-#define CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM 0
+#define CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM 1
 
 #define CONFIG_BT_NIMBLE_HS_FLOW_CTRL 1
 #define CONFIG_BT_NIMBLE_HS_FLOW_CTRL_ITVL 1000
@@ -0,0 +1,441 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include "common/imuProtocol.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+constexpr float SMALLEST_THREE_RANGE = 0.70710678f; // The three smallest lie in +-1/sqrt(2)
+constexpr float Q14_SCALE = 16384.0f;   // 1.0 in the DMP's Q14 fixed point
+constexpr float GYRO_SCALE = 16.4f * 180.0f / 3.14159265f;  // DMP gyro LSB per rad/s
+constexpr float ACCEL_SCALE = 8192.0f;  // DMP accel LSB per g
+constexpr size_t DMP_GYRO_OFFSET = 16;  // Where the gyro words start in a DMP packet
+constexpr size_t DMP_ACCEL_OFFSET = 28; // Where the accel words start in a DMP packet
+
+// Wire size of each EXTENDED field, in ImuField order
+constexpr size_t FIELD_SIZES[] = {4 * sizeof(int16_t), 3 * sizeof(int16_t), 3 * sizeof(int16_t),
+                                  sizeof(uint16_t), sizeof(uint32_t)};
+static_assert(sizeof(FIELD_SIZES) / sizeof(FIELD_SIZES[0]) ==
+              static_cast<size_t>(ImuField::COUNT), "Every ImuField needs a size");
+
+// For each dropped index, where the three remaining components go
+constexpr uint8_t SMALLEST_THREE_SLOTS[4][3] = {{1, 2, 3}, {0, 2, 3}, {0, 1, 3}, {0, 1, 2}};
+
+/**
+ * Write the low bytes of a value little-endian
+ *
+ * @param value - The value to write
+ * @param out - Where to write it
+ * @param bytes - The number of bytes to write
+ */
+void writeLittleEndian(uint64_t value, uint8_t *out, size_t bytes) {
+    for (size_t i(0); i < bytes; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+/**
+ * Read a little-endian value
+ *
+ * @param in - Where to read from
+ * @param bytes - The number of bytes to read
+ * @return The value
+ */
+uint64_t readLittleEndian(const uint8_t *in, size_t bytes) {
+    uint64_t value(0);
+    for (size_t i(0); i < bytes; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+/**
+ * Read a big-endian signed 16 bit word, the DMP's byte order
+ *
+ * @param in - Where to read from
+ * @return The word
+ */
+int16_t readBigEndian16(const uint8_t *in) {
+    return static_cast<int16_t>((static_cast<uint16_t>(in[0]) << 8) | in[1]);
+}
+
+/**
+ * Copy the high (big-endian) word of each 32 bit DMP value
+ *
+ * @param in - The DMP values
+ * @param count - The number of values
+ * @param out - Where to write the words
+ */
+void copyHighWords(const uint8_t *in, size_t count, uint8_t *out) {
+    for (size_t i(0); i < count; ++i) {
+        out[2 * i] = in[4 * i];
+        out[2 * i + 1] = in[4 * i + 1];
+    }
+}
+
+/**
+ * Read big-endian words scaled to floats
+ *
+ * @param in - The words
+ * @param out - Where to store the values
+ * @param count - The number of words
+ * @param scale - The number of LSB per unit
+ */
+void readScaled(const uint8_t *in, float *out, size_t count, float scale) {
+    for (size_t i(0); i < count; ++i) {
+        out[i] = static_cast<float>(readBigEndian16(&in[2 * i])) / scale;
+    }
+}
+}
+
+uint8_t ImuCodec::supportedFormats() {
+    return formatBit(ImuFormat::LEGACY) | formatBit(ImuFormat::RAW_FLOAT) |
+           formatBit(ImuFormat::SMALLEST_THREE_32) | formatBit(ImuFormat::SMALLEST_THREE_48) |
+           formatBit(ImuFormat::DMP_Q14) | formatBit(ImuFormat::EXTENDED) |
+           formatBit(ImuFormat::BATCH);
+}
+
+uint8_t ImuCodec::supportedFields() {
+    return fieldBit(ImuField::QUATERNION) | fieldBit(ImuField::GYRO) | fieldBit(ImuField::ACCEL) |
+           fieldBit(ImuField::SEQUENCE) | fieldBit(ImuField::TIMESTAMP);
+}
+
+size_t ImuCodec::packetSize(ImuFormat format, uint8_t fields) {
+    switch (format) {
+        case ImuFormat::LEGACY:
+            return LEGACY_PACKET_SIZE;
+        case ImuFormat::RAW_FLOAT:
+            return 1 + 4 * sizeof(float);
+        case ImuFormat::SMALLEST_THREE_32:
+            return 1 + 4;
+        case ImuFormat::SMALLEST_THREE_48:
+            return 1 + 6;
+        case ImuFormat::DMP_Q14:
+            return 1 + 4 * sizeof(int16_t);
+        case ImuFormat::EXTENDED: {
+            if (!(fields & fieldBit(ImuField::QUATERNION)) || (fields & ~supportedFields())) {
+                return 0;
+            }
+
+            size_t size(2);
+            for (uint8_t i(0); i < static_cast<uint8_t>(ImuField::COUNT); ++i) {
+                if (fields & (1u << i)) {
+                    size += FIELD_SIZES[i];
+                }
+            }
+
+            // Pad so the packet is never mistaken for a legacy one
+            return size == LEGACY_PACKET_SIZE ? size + 1 : size;
+        }
+        default:
+            return 0;
+    }
+}
+
+size_t ImuCodec::encode(ImuFormat format, const std::array<float, 4> &q, uint8_t *out) {
+    switch (format) {
+        case ImuFormat::LEGACY:
+            memcpy(out, q.data(), 4 * sizeof(float));
+            break;
+        case ImuFormat::RAW_FLOAT:
+            out[0] = static_cast<uint8_t>(format);
+            memcpy(&out[1], q.data(), 4 * sizeof(float));
+            break;
+        case ImuFormat::SMALLEST_THREE_32:
+            out[0] = static_cast<uint8_t>(format);
+            writeLittleEndian(packSmallestThree(q, 10), &out[1], 4);
+            break;
+        case ImuFormat::SMALLEST_THREE_48:
+            out[0] = static_cast<uint8_t>(format);
+            writeLittleEndian(packSmallestThree(q, 15), &out[1], 6);
+            break;
+        case ImuFormat::DMP_Q14:
+            out[0] = static_cast<uint8_t>(format);
+            for (size_t i(0); i < 4; ++i) {
+                const auto word = static_cast<int16_t>(lroundf(fminf(fmaxf(q[i], -1.0f), 1.0f) *
+                                                               Q14_SCALE));
+                out[1 + 2 * i] = static_cast<uint8_t>(static_cast<uint16_t>(word) >> 8);
+                out[2 + 2 * i] = static_cast<uint8_t>(word);
+            }
+            break;
+        default:
+            return 0;
+    }
+
+    return packetSize(format);
+}
+
+size_t ImuCodec::encodeDmpPacket(ImuFormat format, const uint8_t *dmpPacket, uint8_t *out,
+                                 uint8_t fields, uint16_t sequence, uint32_t timestamp) {
+    if (format == ImuFormat::DMP_Q14) {
+        // The high word of each Q30 value is the Q14 value
+        out[0] = static_cast<uint8_t>(format);
+        copyHighWords(dmpPacket, 4, &out[1]);
+        return packetSize(format);
+    }
+
+    if (format == ImuFormat::EXTENDED) {
+        const size_t size = packetSize(format, fields);
+        if (size == 0) {
+            return 0;
+        }
+
+        out[0] = static_cast<uint8_t>(format);
+        out[1] = fields;
+        uint8_t *field = &out[2];
+
+        copyHighWords(dmpPacket, 4, field);
+        field += FIELD_SIZES[static_cast<uint8_t>(ImuField::QUATERNION)];
+        if (fields & fieldBit(ImuField::GYRO)) {
+            copyHighWords(&dmpPacket[DMP_GYRO_OFFSET], 3, field);
+            field += FIELD_SIZES[static_cast<uint8_t>(ImuField::GYRO)];
+        }
+        if (fields & fieldBit(ImuField::ACCEL)) {
+            copyHighWords(&dmpPacket[DMP_ACCEL_OFFSET], 3, field);
+            field += FIELD_SIZES[static_cast<uint8_t>(ImuField::ACCEL)];
+        }
+        if (fields & fieldBit(ImuField::SEQUENCE)) {
+            writeLittleEndian(sequence, field, 2);
+            field += FIELD_SIZES[static_cast<uint8_t>(ImuField::SEQUENCE)];
+        }
+        if (fields & fieldBit(ImuField::TIMESTAMP)) {
+            writeLittleEndian(timestamp, field, 4);
+            field += FIELD_SIZES[static_cast<uint8_t>(ImuField::TIMESTAMP)];
+        }
+
+        // Zero the pad byte, if any, rather than sending whatever was in the buffer
+        memset(field, 0, size - (field - out));
+        return size;
+    }
+
+    std::array<float, 4> q{};
+    for (size_t i(0); i < 4; ++i) {
+        q[i] = static_cast<float>(readBigEndian16(&dmpPacket[4 * i])) / Q14_SCALE;
+    }
+    return encode(format, q, out);
+}
+
+size_t ImuCodec::finishBatch(uint8_t *batch, size_t length, uint8_t count) {
+    batch[0] = static_cast<uint8_t>(ImuFormat::BATCH);
+    batch[1] = count;
+
+    // Pad so the batch is never mistaken for a legacy packet
+    if (length == LEGACY_PACKET_SIZE) {
+        batch[length] = 0;
+        return length + 1;
+    }
+
+    return length;
+}
+
+size_t ImuCodec::packetLength(const uint8_t *data, size_t length) {
+    if (length == 0 || data[0] == static_cast<uint8_t>(ImuFormat::LEGACY) ||
+        data[0] == static_cast<uint8_t>(ImuFormat::BATCH) ||
+        data[0] >= static_cast<uint8_t>(ImuFormat::COUNT)) {
+        return 0;
+    }
+
+    size_t size;
+    if (data[0] == static_cast<uint8_t>(ImuFormat::EXTENDED)) {
+        size = length >= 2 ? packetSize(ImuFormat::EXTENDED, data[1]) : 0;
+    } else {
+        size = packetSize(static_cast<ImuFormat>(data[0]));
+    }
+
+    return size <= length ? size : 0;
+}
+
+bool ImuCodec::isValid(const uint8_t *data, size_t length) {
+    if (length == LEGACY_PACKET_SIZE) {
+        return true;
+    }
+
+    if (length >= BATCH_HEADER_SIZE && data[0] == static_cast<uint8_t>(ImuFormat::BATCH)) {
+        // Walk the packets, which must all share the first one's format
+        size_t offset = BATCH_HEADER_SIZE;
+        for (uint8_t i(0); i < data[1]; ++i) {
+            const size_t size = packetLength(&data[offset], length - offset);
+            if (size == 0 || data[offset] != data[BATCH_HEADER_SIZE]) {
+                return false;
+            }
+            offset += size;
+        }
+
+        return data[1] > 0 &&
+               (offset == length || (offset == LEGACY_PACKET_SIZE && length == offset + 1));
+    }
+
+    if (length >= 2 && data[0] == static_cast<uint8_t>(ImuFormat::EXTENDED)) {
+        return length == packetSize(ImuFormat::EXTENDED, data[1]);
+    }
+
+    return length != 0 && data[0] != static_cast<uint8_t>(ImuFormat::LEGACY) &&
+           data[0] < static_cast<uint8_t>(ImuFormat::COUNT) &&
+           length == packetSize(static_cast<ImuFormat>(data[0]));
+}
+
+bool ImuCodec::decode(const uint8_t *data, size_t length, std::array<float, 4> &q) {
+    if (length == LEGACY_PACKET_SIZE) {
+        memcpy(q.data(), data, 4 * sizeof(float));
+        return true;
+    }
+
+    if (!isValid(data, length)) {
+        return false;
+    }
+
+    switch (static_cast<ImuFormat>(data[0])) {
+        case ImuFormat::RAW_FLOAT:
+            memcpy(q.data(), &data[1], 4 * sizeof(float));
+            return true;
+        case ImuFormat::SMALLEST_THREE_32:
+            unpackSmallestThree(readLittleEndian(&data[1], 4), 10, q);
+            return true;
+        case ImuFormat::SMALLEST_THREE_48:
+            unpackSmallestThree(readLittleEndian(&data[1], 6), 15, q);
+            return true;
+        case ImuFormat::DMP_Q14:
+            readScaled(&data[1], q.data(), 4, Q14_SCALE);
+            return true;
+        case ImuFormat::EXTENDED:
+            readScaled(&data[2], q.data(), 4, Q14_SCALE);
+            return true;
+        case ImuFormat::BATCH: {
+            size_t newestLength;
+            const uint8_t *newest = newestInBatch(data, length, newestLength);
+            return decode(newest, newestLength, q);
+        }
+        default:
+            return false;
+    }
+}
+
+bool ImuCodec::decode(const uint8_t *data, size_t length, ImuSample &sample, uint8_t fields) {
+    if (!isValid(data, length)) {
+        return false;
+    }
+
+    if (length != LEGACY_PACKET_SIZE && data[0] == static_cast<uint8_t>(ImuFormat::BATCH)) {
+        size_t newestLength;
+        const uint8_t *newest = newestInBatch(data, length, newestLength);
+        return decode(newest, newestLength, sample, fields);
+    }
+
+    // Other formats only hold a quaternion
+    if (length == LEGACY_PACKET_SIZE || data[0] != static_cast<uint8_t>(ImuFormat::EXTENDED)) {
+        sample.fields = fields & fieldBit(ImuField::QUATERNION);
+        return !sample.fields || decode(data, length, sample.quaternion);
+    }
+
+    // Walk the fields present, decoding the wanted ones
+    const uint8_t present = data[1];
+    const uint8_t *field = &data[2];
+    sample.fields = present & fields;
+
+    if (sample.fields & fieldBit(ImuField::QUATERNION)) {
+        readScaled(field, sample.quaternion.data(), 4, Q14_SCALE);
+    }
+    field += FIELD_SIZES[static_cast<uint8_t>(ImuField::QUATERNION)];
+
+    if (present & fieldBit(ImuField::GYRO)) {
+        if (fields & fieldBit(ImuField::GYRO)) {
+            readScaled(field, sample.gyro.data(), 3, GYRO_SCALE);
+        }
+        field += FIELD_SIZES[static_cast<uint8_t>(ImuField::GYRO)];
+    }
+
+    if (present & fieldBit(ImuField::ACCEL)) {
+        if (fields & fieldBit(ImuField::ACCEL)) {
+            readScaled(field, sample.accel.data(), 3, ACCEL_SCALE);
+        }
+        field += FIELD_SIZES[static_cast<uint8_t>(ImuField::ACCEL)];
+    }
+
+    if (present & fieldBit(ImuField::SEQUENCE)) {
+        if (fields & fieldBit(ImuField::SEQUENCE)) {
+            sample.sequence = static_cast<uint16_t>(readLittleEndian(field, 2));
+        }
+        field += FIELD_SIZES[static_cast<uint8_t>(ImuField::SEQUENCE)];
+    }
+
+    if ((present & fields) & fieldBit(ImuField::TIMESTAMP)) {
+        sample.timestamp = static_cast<uint32_t>(readLittleEndian(field, 4));
+    }
+
+    return true;
+}
+
+ImuFormat ImuCodec::negotiate(uint8_t serverFormats, ImuFormat preferred) {
+    const uint8_t shared = serverFormats & supportedFormats();
+
+    if (preferred != ImuFormat::BATCH && (shared & formatBit(preferred))) {
+        return preferred;
+    }
+
+    // Fall back from the best precision per byte
+    // EXTENDED is never a fallback since it carries fields the client did not ask for
+    for (ImuFormat format : {ImuFormat::SMALLEST_THREE_48, ImuFormat::DMP_Q14,
+                             ImuFormat::SMALLEST_THREE_32, ImuFormat::RAW_FLOAT}) {
+        if (shared & formatBit(format)) {
+            return format;
+        }
+    }
+
+    return ImuFormat::LEGACY;
+}
+
+const uint8_t *ImuCodec::newestInBatch(const uint8_t *batch, size_t length,
+                                       size_t &newestLength) {
+    size_t offset = BATCH_HEADER_SIZE;
+    newestLength = packetLength(&batch[offset], length - offset);
+    for (uint8_t i(1); i < batch[1]; ++i) {
+        offset += newestLength;
+        newestLength = packetLength(&batch[offset], length - offset);
+    }
+
+    return &batch[offset];
+}
+
+uint64_t ImuCodec::packSmallestThree(const std::array<float, 4> &q, uint8_t bits) {
+    // Find the largest magnitude component
+    uint8_t largest(0);
+    for (uint8_t i(1); i < 4; ++i) {
+        if (fabsf(q[i]) > fabsf(q[largest])) {
+            largest = i;
+        }
+    }
+
+    // q and -q are the same rotation, so flip the sign to make the dropped component positive
+    const float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+    const float maxValue = static_cast<float>((1u << bits) - 1);
+    const float scale = maxValue / (2.0f * SMALLEST_THREE_RANGE);
+
+    uint64_t packed = largest;
+    for (uint8_t slot : SMALLEST_THREE_SLOTS[largest]) {
+        float value = (q[slot] * sign + SMALLEST_THREE_RANGE) * scale;
+        value = fminf(fmaxf(value, 0.0f), maxValue);
+        packed = (packed << bits) | static_cast<uint32_t>(value + 0.5f);
+    }
+
+    return packed;
+}
+
+void ImuCodec::unpackSmallestThree(uint64_t packed, uint8_t bits, std::array<float, 4> &q) {
+    const uint32_t mask = (1u << bits) - 1;
+    const float scale = 2.0f * SMALLEST_THREE_RANGE / static_cast<float>(mask);
+    const uint8_t largest = (packed >> (3 * bits)) & 0x3;
+
+    const float a = static_cast<float>((packed >> (2 * bits)) & mask) * scale -
+                    SMALLEST_THREE_RANGE;
+    const float b = static_cast<float>((packed >> bits) & mask) * scale - SMALLEST_THREE_RANGE;
+    const float c = static_cast<float>(packed & mask) * scale - SMALLEST_THREE_RANGE;
+
+    // Scatter through the slot table rather than branching on the index
+    const uint8_t *slots = SMALLEST_THREE_SLOTS[largest];
+    q[largest] = sqrtf(fmaxf(0.0f, 1.0f - a * a - b * b - c * c));
+    q[slots[0]] = a;
+    q[slots[1]] = b;
+    q[slots[2]] = c;
+}
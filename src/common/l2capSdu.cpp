@@ -0,0 +1,11 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include "common/l2capSdu.h"
+#include <nimble/porting/nimble/include/os/os_mbuf.h>
+
+int readyNextSdu(ble_l2cap_chan *channel, uint16_t size) {
+    os_mbuf *sdu = os_msys_get_pkthdr(size, 0);
+    return sdu != nullptr ? ble_l2cap_recv_ready(channel, sdu) : BLE_HS_ENOMEM;
+}
@@ -1,13 +1,34 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 11/26/2024
+// Last Modified: 10/18/2026
 
 #include "control/controlAlgoImpl.h"
 
+namespace {
+    constexpr uint8_t WHEEL_COUNT = MechanismGeometry::WHEEL_COUNT;
+
+    /**
+     * Build the mechanism frame wheel directions at compile time, contact directions first
+     *
+     * @return The contact directions followed by the drive directions
+     */
+    constexpr std::array<VectorFloat, 2 * WHEEL_COUNT> wheelDirections() {
+        std::array<VectorFloat, 2 * WHEEL_COUNT> directions{};
+        for (uint8_t i(0); i < WHEEL_COUNT; ++i) {
+            directions[i] = MechanismGeometry::contactDirection(i);
+            directions[WHEEL_COUNT + i] = MechanismGeometry::driveDirection(i);
+        }
+
+        return directions;
+    }
+
+    constexpr std::array<VectorFloat, 2 * WHEEL_COUNT> WHEEL_DIRECTIONS = wheelDirections();
+} // namespace
+
 void ControlAlgoImpl::execute() {
     setTargetQuaternion();
     setCurrentQuaternion();
-    slerp();
+    interpolated = slerp();
     calculateAngularVelocity();
     applyInverseKinematics();
     PID();
@@ -22,12 +43,42 @@ ExtendedQuaternion ControlAlgoImpl::slerp() {
 }
 
 void ControlAlgoImpl::calculateAngularVelocity() {
-    //todo why am i even calculating angular velo? How do i know what i need to get from quat to
-    // velo
+    const uint32_t now = micros();
+
+    if (hasPrev && now != prevTime) {
+        const float dt = static_cast<float>(now - prevTime) * 1e-6f;
+        angularVelocity = ExtendedQuaternion::angularVelocity(prevInterpolated, interpolated, dt);
+    } else {
+        angularVelocity = VectorFloat();
+    }
+
+    Log.verboseln("\tAngular Velocity:\t%D\t%D\t%D", angularVelocity.x, angularVelocity.y,
+                  angularVelocity.z);
+
+    prevInterpolated = interpolated;
+    prevTime = now;
+    hasPrev = true;
 }
 
 void ControlAlgoImpl::applyInverseKinematics() {
-    // todo whats the math to go from the above to motor commands?
+    // interpolated takes body vectors into the mechanism frame, so its conjugate goes back
+    bodyFromMechanism.set(interpolated.conjugate());
+
+    VectorFloat body[2 * WHEEL_COUNT];
+    bodyFromMechanism.rotate(WHEEL_DIRECTIONS.data(), body, 2 * WHEEL_COUNT);
+
+    // Surface velocity at the contact point is w x c, and the wheel only drives along d
+    const VectorFloat &w = angularVelocity;
+    for (uint8_t i(0); i < WHEEL_COUNT; ++i) {
+        const VectorFloat &c = body[i];
+        const VectorFloat &d = body[WHEEL_COUNT + i];
+        wheelRates[i] = (w.y * c.z - w.z * c.y) * d.x + (w.z * c.x - w.x * c.z) * d.y +
+                        (w.x * c.y - w.y * c.x) * d.z;
+    }
+
+    Log.verboseln("\tWheel Rates:\t%D\t%D\t%D", wheelRates[0], wheelRates[1], wheelRates[2]);
+
+    // todo scale wheelRates by the eyeball and wheel radii into motor commands
 }
 
 void ControlAlgoImpl::PID() {
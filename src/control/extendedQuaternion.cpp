@@ -1,22 +1,78 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 11/28/2024
+// Last Modified: 10/18/2026
 
 #include "control/extendedQuaternion.h"
 
-ExtendedQuaternion::ExtendedQuaternion() : Quaternion() {}
+namespace {
+constexpr float TAYLOR_THRESHOLD = 1e-3f; // Below this |v| the Taylor expansions are used
+}
+
+float ExtendedQuaternion::norm() const {
+    return FastMath::magnitude(*this);
+}
 
-ExtendedQuaternion::ExtendedQuaternion(float w, float x, float y, float z) : Quaternion(w, x, y,
-                                                                                        z) {}
+void ExtendedQuaternion::normalizeInPlace() {
+    FastMath::normalize(*this);
+}
 
-ExtendedQuaternion ExtendedQuaternion::operator-() const {
-    return {-w, -x, -y, -z};
+ExtendedQuaternion ExtendedQuaternion::normalized() const {
+    ExtendedQuaternion r(*this);
+    r.normalizeInPlace();
+    return r;
 }
 
-float ExtendedQuaternion::dot(const Quaternion &rhs) const {
-    return (w * rhs.w) + (x * rhs.x) + (y * rhs.y) + (z * rhs.z);
+void ExtendedQuaternion::rotate(VectorFloat &v) const {
+    FastMath::rotate(*this, v);
 }
 
-float ExtendedQuaternion::dot(const ExtendedQuaternion &rhs) const {
-    return (w * rhs.w) + (x * rhs.x) + (y * rhs.y) + (z * rhs.z);
+VectorFloat ExtendedQuaternion::log() const {
+    const float squared = x * x + y * y + z * z;
+    const float norm = sqrtf(squared);
+
+    // atan2(|v|, w) / |v| ~= (1 / w) * (1 - |v|^2 / (3 * w^2)) for small |v| near identity
+    // -1 is a full turn about any axis - atan2(0, -1) / 0 would turn the zero vector into NaN
+    if (norm == 0.0f) {
+        return {0.0f, 0.0f, 0.0f};
+    }
+
+    float scale;
+    if (norm < TAYLOR_THRESHOLD && w > 0.0f) {
+        scale = (1.0f - squared / (3.0f * w * w)) / w;
+    } else {
+        scale = atan2f(norm, w) / norm;
+    }
+
+    return {x * scale, y * scale, z * scale};
+}
+
+ExtendedQuaternion ExtendedQuaternion::exp(const VectorFloat &v) {
+    const float squared = v.x * v.x + v.y * v.y + v.z * v.z;
+    const float norm = sqrtf(squared);
+
+    // sin(t) / t ~= 1 - t^2 / 6 and cos(t) ~= 1 - t^2 / 2 + t^4 / 24 for small t
+    float scale, w;
+    if (norm < TAYLOR_THRESHOLD) {
+        scale = 1.0f - squared / 6.0f;
+        w = 1.0f - 0.5f * squared + squared * squared / 24.0f;
+    } else {
+        scale = sinf(norm) / norm;
+        w = cosf(norm);
+    }
+
+    return {w, v.x * scale, v.y * scale, v.z * scale};
+}
+
+VectorFloat ExtendedQuaternion::angularVelocity(const ExtendedQuaternion &from,
+                                                const ExtendedQuaternion &to, float dt) {
+    ExtendedQuaternion delta = from.conjugate() * to;
+
+    // q and -q are the same rotation - take the short way round
+    if (delta.w < 0.0f) {
+        delta = -delta;
+    }
+
+    const VectorFloat halfAngle = delta.log();
+    const float scale = 2.0f / dt;
+    return {halfAngle.x * scale, halfAngle.y * scale, halfAngle.z * scale};
 }
\ No newline at end of file
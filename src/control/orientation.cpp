@@ -0,0 +1,39 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include "control/orientation.h"
+
+Orientation::Orientation(const ExtendedQuaternion &q) : quaternion(q) {}
+
+void Orientation::set(const ExtendedQuaternion &q) {
+    quaternion = q;
+    matrixValid = false;
+}
+
+const ExtendedQuaternion &Orientation::get() const { return quaternion; }
+
+const RotationMatrix &Orientation::getMatrix() {
+    if (!matrixValid) {
+        matrix = quaternion.toRotationMatrix();
+        matrixValid = true;
+    }
+
+    return matrix;
+}
+
+void Orientation::rotate(VectorFloat &v) const {
+    if (matrixValid) {
+        v = matrix.apply(v);
+    } else {
+        quaternion.rotate(v);
+    }
+}
+
+void Orientation::rotate(const VectorFloat *in, VectorFloat *out, size_t count) {
+    const RotationMatrix &m = getMatrix();
+
+    for (size_t i(0); i < count; ++i) {
+        out[i] = m.apply(in[i]);
+    }
+}
@@ -0,0 +1,121 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include "control/quaternionBatch.h"
+#include <cmath>
+
+namespace {
+constexpr float SLERP_THRESHOLD = 0.9995f; // Above this cosine slerp degrades to nlerp
+}
+
+void QuaternionBatch::multiply(const QuaternionArray &lhs, const QuaternionArray &rhs,
+                               const QuaternionArray &out, size_t count) {
+    for (size_t i(0); i < count; ++i) {
+        const float w1 = lhs.w[i], x1 = lhs.x[i], y1 = lhs.y[i], z1 = lhs.z[i];
+        const float w2 = rhs.w[i], x2 = rhs.x[i], y2 = rhs.y[i], z2 = rhs.z[i];
+
+        out.w[i] = w1 * w2 - x1 * x2 - y1 * y2 - z1 * z2;
+        out.x[i] = w1 * x2 + x1 * w2 + y1 * z2 - z1 * y2;
+        out.y[i] = w1 * y2 - x1 * z2 + y1 * w2 + z1 * x2;
+        out.z[i] = w1 * z2 + x1 * y2 - y1 * x2 + z1 * w2;
+    }
+}
+
+void QuaternionBatch::conjugate(const QuaternionArray &in, const QuaternionArray &out,
+                                size_t count) {
+    for (size_t i(0); i < count; ++i) {
+        out.w[i] = in.w[i];
+        out.x[i] = -in.x[i];
+        out.y[i] = -in.y[i];
+        out.z[i] = -in.z[i];
+    }
+}
+
+void QuaternionBatch::normalize(const QuaternionArray &q, size_t count) {
+    for (size_t i(0); i < count; ++i) {
+        const float squared = q.w[i] * q.w[i] + q.x[i] * q.x[i] + q.y[i] * q.y[i] +
+                              q.z[i] * q.z[i];
+
+        if (squared > 0.0f) {
+            const float scale = 1.0f / sqrtf(squared);
+            q.w[i] *= scale;
+            q.x[i] *= scale;
+            q.y[i] *= scale;
+            q.z[i] *= scale;
+        }
+    }
+}
+
+void QuaternionBatch::rotate(const QuaternionArray &q, const VectorArray &in,
+                             const VectorArray &out, size_t count) {
+    // v' = v + w * t + (q x t) where t = 2 * (q x v). This is the expanded form of
+    // q * v * conj(q) for unit quaternions and avoids building the intermediate products
+    for (size_t i(0); i < count; ++i) {
+        const float w = q.w[i], qx = q.x[i], qy = q.y[i], qz = q.z[i];
+        const float vx = in.x[i], vy = in.y[i], vz = in.z[i];
+
+        const float tx = 2.0f * (qy * vz - qz * vy);
+        const float ty = 2.0f * (qz * vx - qx * vz);
+        const float tz = 2.0f * (qx * vy - qy * vx);
+
+        out.x[i] = vx + w * tx + (qy * tz - qz * ty);
+        out.y[i] = vy + w * ty + (qz * tx - qx * tz);
+        out.z[i] = vz + w * tz + (qx * ty - qy * tx);
+    }
+}
+
+void QuaternionBatch::dot(const QuaternionArray &lhs, const QuaternionArray &rhs, float *out,
+                          size_t count) {
+    for (size_t i(0); i < count; ++i) {
+        out[i] = lhs.w[i] * rhs.w[i] + lhs.x[i] * rhs.x[i] + lhs.y[i] * rhs.y[i] +
+                 lhs.z[i] * rhs.z[i];
+    }
+}
+
+void QuaternionBatch::slerp(const QuaternionArray &from, const QuaternionArray &to, float t,
+                            const QuaternionArray &out, size_t count) {
+    for (size_t i(0); i < count; ++i) {
+        float w2 = to.w[i], x2 = to.x[i], y2 = to.y[i], z2 = to.z[i];
+        float cosTheta = from.w[i] * w2 + from.x[i] * x2 + from.y[i] * y2 + from.z[i] * z2;
+
+        // Take the shortest arc
+        if (cosTheta < 0.0f) {
+            w2 = -w2;
+            x2 = -x2;
+            y2 = -y2;
+            z2 = -z2;
+            cosTheta = -cosTheta;
+        }
+
+        float a, b;
+        if (cosTheta > SLERP_THRESHOLD) {
+            a = 1.0f - t;
+            b = t;
+        } else {
+            const float theta = acosf(cosTheta);
+            const float inverseSin = 1.0f / sqrtf(1.0f - cosTheta * cosTheta);
+            a = sinf((1.0f - t) * theta) * inverseSin;
+            b = sinf(t * theta) * inverseSin;
+        }
+
+        float w = a * from.w[i] + b * w2;
+        float x = a * from.x[i] + b * x2;
+        float y = a * from.y[i] + b * y2;
+        float z = a * from.z[i] + b * z2;
+
+        // Only the nlerp branch drifts off the unit sphere noticeably
+        if (cosTheta > SLERP_THRESHOLD) {
+            const float scale = 1.0f / sqrtf(w * w + x * x + y * y + z * z);
+            w *= scale;
+            x *= scale;
+            y *= scale;
+            z *= scale;
+        }
+
+        out.w[i] = w;
+        out.x[i] = x;
+        out.y[i] = y;
+        out.z[i] = z;
+    }
+}
@@ -0,0 +1,163 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include <Arduino.h>
+#include "control/fastMath.h"
+
+// Configuration variables - set these to size the tests
+constexpr size_t SAMPLES = 1000;
+constexpr float INV_SQRT_TOLERANCE = 2e-3f;     // Max relative error of invSqrt
+constexpr float NORMALIZE_TOLERANCE = 1e-5f;    // Max |1 - magnitude| after normalize
+constexpr float ROTATE_TOLERANCE = 1e-5f;       // Max relative error against VectorFloat::rotate
+constexpr uint32_t BAUD_RATE = 115200;
+
+// Program variables
+Quaternion quaternions[SAMPLES];
+VectorFloat vectors[SAMPLES];
+volatile float sink; // Keeps the benchmarked results alive
+
+/**
+ * Get a random float in [-1, 1)
+ *
+ * @return The random float
+ */
+float randomUnit() { return random(-100000, 100000) / 100000.0f; }
+
+/**
+ * Print the result of an accuracy check
+ *
+ * @param name - The name of the check
+ * @param error - The worst error seen
+ * @param tolerance - The allowed error
+ */
+void check(const char *name, float error, float tolerance) {
+    Serial.printf("%-22s max error: %e\t%s\n", name, error, error <= tolerance ? "PASS" : "FAIL");
+}
+
+/**
+ * Print the average cycles per call for the helper and FastMath versions of an operation
+ *
+ * @param name - The name of the operation
+ * @param helperCycles - Total cycles taken by helper_3dmath
+ * @param fastCycles - Total cycles taken by FastMath
+ */
+void report(const char *name, uint32_t helperCycles, uint32_t fastCycles) {
+    Serial.printf("%-22s helper: %7.1f cyc\tfast: %7.1f cyc\tspeedup: %.2fx\n", name,
+                  helperCycles / static_cast<float>(SAMPLES),
+                  fastCycles / static_cast<float>(SAMPLES),
+                  static_cast<float>(helperCycles) / fastCycles);
+}
+
+void setup() {
+    Serial.begin(BAUD_RATE);
+
+    for (size_t i(0); i < SAMPLES; ++i) {
+        quaternions[i] = Quaternion(randomUnit(), randomUnit(), randomUnit(), randomUnit());
+        vectors[i] = VectorFloat(randomUnit(), randomUnit(), randomUnit());
+    }
+
+    // Accuracy - invSqrt over six decades
+    float error(0.0f);
+    for (float x(1e-3f); x < 1e3f; x *= 1.01f) {
+        error = max(error, fabsf(FastMath::invSqrt(x) * sqrtf(x) - 1.0f));
+    }
+    check("invSqrt", error, INV_SQRT_TOLERANCE);
+
+    // Accuracy - normalize
+    error = 0.0f;
+    for (const Quaternion &sample : quaternions) {
+        Quaternion q(sample.w, sample.x, sample.y, sample.z);
+        FastMath::normalize(q);
+        error = max(error, fabsf(FastMath::magnitude(q) - 1.0f));
+    }
+    check("normalize", error, NORMALIZE_TOLERANCE);
+
+    // Accuracy - normalize leaves unit quaternions untouched
+    error = 0.0f;
+    for (const Quaternion &sample : quaternions) {
+        Quaternion unit = Quaternion(sample.w, sample.x, sample.y, sample.z).getNormalized();
+        Quaternion q(unit.w, unit.x, unit.y, unit.z);
+        FastMath::normalize(q);
+        error = max(error, fabsf(q.w - unit.w) + fabsf(q.x - unit.x) + fabsf(q.y - unit.y) +
+                           fabsf(q.z - unit.z));
+    }
+    check("normalize (unit skip)", error, NORMALIZE_TOLERANCE);
+
+    // Accuracy - direct rotation against the two product sandwich
+    error = 0.0f;
+    for (size_t i(0); i < SAMPLES; ++i) {
+        Quaternion q = quaternions[i].getNormalized();
+        VectorFloat expected = vectors[i].getRotated(&q);
+        VectorFloat actual = FastMath::getRotated(q, vectors[i]);
+        float scale = max(FastMath::magnitude(vectors[i]), 1e-6f);
+        error = max(error, (fabsf(actual.x - expected.x) + fabsf(actual.y - expected.y) +
+                            fabsf(actual.z - expected.z)) / scale);
+    }
+    check("rotate", error, ROTATE_TOLERANCE);
+
+    // Cycles - magnitude
+    uint32_t helperCycles, fastCycles, start;
+    start = ESP.getCycleCount();
+    for (Quaternion &q : quaternions) {
+        sink = q.getMagnitude();
+    }
+    helperCycles = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (const Quaternion &q : quaternions) {
+        sink = FastMath::magnitude(q);
+    }
+    fastCycles = ESP.getCycleCount() - start;
+    report("magnitude", helperCycles, fastCycles);
+
+    // Cycles - normalize of non-unit quaternions
+    start = ESP.getCycleCount();
+    for (Quaternion &q : quaternions) {
+        sink = q.getNormalized().w;
+    }
+    helperCycles = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (const Quaternion &sample : quaternions) {
+        Quaternion q(sample.w, sample.x, sample.y, sample.z);
+        FastMath::normalize(q);
+        sink = q.w;
+    }
+    fastCycles = ESP.getCycleCount() - start;
+    report("normalize", helperCycles, fastCycles);
+
+    // Cycles - normalize of already unit quaternions
+    for (Quaternion &q : quaternions) {
+        q.normalize();
+    }
+    start = ESP.getCycleCount();
+    for (Quaternion &q : quaternions) {
+        sink = q.getNormalized().w;
+    }
+    helperCycles = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (Quaternion &q : quaternions) {
+        FastMath::normalize(q);
+        sink = q.w;
+    }
+    fastCycles = ESP.getCycleCount() - start;
+    report("normalize (unit)", helperCycles, fastCycles);
+
+    // Cycles - rotate
+    start = ESP.getCycleCount();
+    for (size_t i(0); i < SAMPLES; ++i) {
+        sink = vectors[i].getRotated(&quaternions[i]).x;
+    }
+    helperCycles = ESP.getCycleCount() - start;
+
+    start = ESP.getCycleCount();
+    for (size_t i(0); i < SAMPLES; ++i) {
+        sink = FastMath::getRotated(quaternions[i], vectors[i]).x;
+    }
+    fastCycles = ESP.getCycleCount() - start;
+    report("rotate", helperCycles, fastCycles);
+}
+
+void loop() {}
@@ -0,0 +1,74 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include <Arduino.h>
+#include "common/imuProtocol.h"
+
+// Configuration variables
+constexpr size_t DMP_PACKET_SIZE = 42;  // Size of a MotionApps20 FIFO packet
+constexpr uint8_t STALE_BYTE = 0xAB;    // Fills the output buffer before each encode
+constexpr uint16_t SEQUENCE = 0x1234;   // Sequence number encoded in each packet
+constexpr uint32_t TIMESTAMP = 0x89ABCDEF;  // Timestamp encoded in each packet
+constexpr uint32_t BAUD_RATE = 115200;
+
+/**
+ * Print the result of a pass/fail check
+ *
+ * @param name - The name of the check
+ * @param failures - The number of field masks that failed
+ */
+void check(const char *name, uint8_t failures) {
+    Serial.printf("%-28s failures: %d\t%s\n", name, failures, failures == 0 ? "PASS" : "FAIL");
+}
+
+void setup() {
+    Serial.begin(BAUD_RATE);
+
+    uint8_t dmpPacket[DMP_PACKET_SIZE];
+    for (size_t i(0); i < DMP_PACKET_SIZE; ++i) {
+        dmpPacket[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    // Every EXTENDED field mask, each encoded into a buffer of stale bytes
+    uint8_t sizeFailures(0), padFailures(0), validFailures(0), decodeFailures(0);
+    for (uint8_t fields(0); fields < 1u << static_cast<uint8_t>(ImuField::COUNT); ++fields) {
+        if (!(fields & fieldBit(ImuField::QUATERNION))) {
+            continue;
+        }
+
+        uint8_t out[MAX_PACKET_SIZE + 1];
+        memset(out, STALE_BYTE, sizeof(out));
+        const size_t size = ImuCodec::encodeDmpPacket(ImuFormat::EXTENDED, dmpPacket, out, fields,
+                                                      SEQUENCE, TIMESTAMP);
+
+        // Length - as packetSize says, never a legacy packet's, and nothing written past it
+        if (size != ImuCodec::packetSize(ImuFormat::EXTENDED, fields) ||
+            size == LEGACY_PACKET_SIZE || size > MAX_PACKET_SIZE || out[size] != STALE_BYTE) {
+            ++sizeFailures;
+        }
+
+        // Padding - a packed 16 byte packet gets one zeroed pad byte
+        if (size == LEGACY_PACKET_SIZE + 1 && out[LEGACY_PACKET_SIZE] != 0) {
+            ++padFailures;
+        }
+
+        if (!ImuCodec::isValid(out, size)) {
+            ++validFailures;
+        }
+
+        ImuSample sample;
+        if (!ImuCodec::decode(out, size, sample, fields) || sample.fields != fields ||
+            ((fields & fieldBit(ImuField::SEQUENCE)) && sample.sequence != SEQUENCE) ||
+            ((fields & fieldBit(ImuField::TIMESTAMP)) && sample.timestamp != TIMESTAMP)) {
+            ++decodeFailures;
+        }
+    }
+
+    check("extended length", sizeFailures);
+    check("extended pad byte", padFailures);
+    check("extended isValid", validFailures);
+    check("extended decode", decodeFailures);
+}
+
+void loop() {}
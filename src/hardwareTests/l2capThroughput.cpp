@@ -0,0 +1,467 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <nimble/nimble/host/include/host/ble_hs.h>
+#include <nimble/porting/nimble/include/os/os_mbuf.h>
+#include "common/l2capSdu.h"
+
+/*
+ * Compares GATT notifications with an L2CAP connection-oriented channel for streaming sensor
+ * data. Flash one ESP32 with ROLE set to SENDER (the server's side) and another with RECEIVER (the
+ * mechanism's side), then watch both serial monitors.
+ *
+ * Once connected, the sender runs four phases:
+ *      GATT stream     notify FRAME_SIZE frames as fast as the host takes them for STREAM_TIME
+ *      GATT ping       notify a frame the receiver writes back, PING_COUNT times
+ *      L2CAP stream    send FRAME_SIZE SDUs as fast as the credits allow for STREAM_TIME
+ *      L2CAP ping      send an SDU the receiver sends back, PING_COUNT times
+ * The receiver reports the throughput and lost frames of each stream. The sender reports the
+ * round trip time of each ping phase; half of it approximates the one way latency, since the two
+ * clocks are not synchronized. Needs CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0 on both boards
+ */
+
+/**
+ * Which side of the link this board is
+ */
+enum class Role : uint8_t {
+    SENDER,     // Peripheral, like the server
+    RECEIVER    // Central, like the mechanism
+};
+
+// Configuration variables - set these to size the tests
+constexpr Role ROLE = Role::SENDER;
+constexpr uint16_t FRAME_SIZE = 244;        // Bytes per stream frame, one LE data packet
+constexpr uint32_t STREAM_TIME = 10000;     // ms per stream phase
+constexpr uint16_t PING_COUNT = 200;        // Pings per ping phase
+constexpr uint32_t PING_GAP = 20;           // ms between pings
+constexpr uint32_t PING_TIMEOUT = 200;      // ms before a ping counts as lost
+constexpr uint16_t CONNECTION_INTERVAL = 6; // 7.5 ms, in 1.25 ms units
+constexpr uint16_t PSM = 0x0081;            // LE PSM the receiver listens on
+constexpr uint32_t BAUD_RATE = 115200;
+
+// Program variables
+const char *SERVICE_UUID = "b0c7e3f2-1a0e-4c55-9a53-5d7c2f6e0a11";
+const char *DATA_UUID = "b0c7e3f2-1a0e-4c55-9a53-5d7c2f6e0a12";
+const char *ECHO_UUID = "b0c7e3f2-1a0e-4c55-9a53-5d7c2f6e0a13";
+constexpr uint8_t PHASE_COUNT = 4;
+constexpr uint8_t END_OF_PHASE = 0xFF;      // First byte of the frame that closes a phase
+constexpr size_t HEADER_SIZE = 9;           // [phase][sequence u32][send time u32]
+const char *PHASE_NAMES[PHASE_COUNT] = {"GATT stream", "GATT ping", "L2CAP stream",
+                                        "L2CAP ping"};
+uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE;
+NimBLECharacteristic *dataCharacteristic = nullptr;
+NimBLERemoteCharacteristic *echoCharacteristic = nullptr;
+ble_l2cap_chan *channel = nullptr;
+SemaphoreHandle_t ready = nullptr;          // Given when the link is ready for a phase
+SemaphoreHandle_t unstalled = nullptr;      // Given when the channel has credits again
+SemaphoreHandle_t echoed = nullptr;         // Given when a ping comes back
+volatile uint32_t lastEcho = 0;             // Sequence number of the latest ping back
+volatile uint32_t lastRoundTrip = 0;        // us the latest ping took
+
+/**
+ * What the receiver saw of a stream phase
+ */
+struct StreamTally {
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+    uint32_t lost = 0;
+    uint32_t nextSequence = 0;
+    uint32_t first = 0;     // micros() of the first frame
+    uint32_t last = 0;      // micros() of the latest frame
+} tallies[PHASE_COUNT];
+
+/**
+ * Write a frame header
+ *
+ * @param frame - The frame
+ * @param phase - The phase
+ * @param sequence - The frame's sequence number
+ */
+void writeHeader(uint8_t *frame, uint8_t phase, uint32_t sequence) {
+    const uint32_t now = micros();
+    frame[0] = phase;
+    memcpy(&frame[1], &sequence, sizeof(sequence));
+    memcpy(&frame[5], &now, sizeof(now));
+}
+
+/**
+ * Send a frame over a phase's transport. GATT frames are retried until the host has a buffer for
+ * them; L2CAP frames wait for credits
+ *
+ * @param phase - The phase
+ * @param frame - The frame
+ * @param length - The length of the frame
+ * @return The number of retries
+ */
+uint32_t sendFrame(uint8_t phase, const uint8_t *frame, size_t length) {
+    const bool l2cap = phase >= 2 && phase != END_OF_PHASE;
+    uint32_t retries = 0;
+
+    while (true) {
+        os_mbuf *om = ble_hs_mbuf_from_flat(frame, length);
+        if (om == nullptr) {
+            ++retries;
+            vTaskDelay(1);
+            continue;
+        }
+
+        if (!l2cap) {
+            // Always consumes om
+            if (ble_gatts_notify_custom(connHandle, dataCharacteristic->getHandle(), om) == 0) {
+                return retries;
+            }
+        } else {
+            const int rc = ble_l2cap_send(channel, om);
+            if (rc == 0) {
+                return retries;
+            }
+            if (rc == BLE_HS_ESTALLED) {
+                xSemaphoreTake(unstalled, portMAX_DELAY);
+                return retries;
+            }
+
+            // Only a refused SDU is still ours. Any other error already freed it
+            if (rc == BLE_HS_EBUSY || rc == BLE_HS_EBADDATA) {
+                os_mbuf_free_chain(om);
+            }
+        }
+
+        ++retries;
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * Send a frame back to the sender over the transport it arrived on
+ *
+ * @param frame - The frame
+ * @param length - The length of the frame
+ * @param l2cap - If it arrived on the L2CAP channel
+ */
+void echoFrame(const uint8_t *frame, size_t length, bool l2cap) {
+    if (!l2cap) {
+        echoCharacteristic->writeValue(frame, length, false);
+        return;
+    }
+
+    os_mbuf *om = ble_hs_mbuf_from_flat(frame, length);
+    if (om == nullptr) {
+        return;
+    }
+
+    // Only a refused SDU is still ours. A stalled one is finished as credits arrive
+    const int rc = ble_l2cap_send(channel, om);
+    if (rc == BLE_HS_EBUSY || rc == BLE_HS_EBADDATA) {
+        os_mbuf_free_chain(om);
+    }
+}
+
+/**
+ * Record a ping coming back to the sender
+ *
+ * @param frame - The echoed frame
+ */
+void recordEcho(const uint8_t *frame) {
+    uint32_t sequence, sent;
+    memcpy(&sequence, &frame[1], sizeof(sequence));
+    memcpy(&sent, &frame[5], sizeof(sent));
+    lastRoundTrip = micros() - sent;
+    lastEcho = sequence;
+    xSemaphoreGive(echoed);
+}
+
+/**
+ * Receiver - handle a frame on either transport
+ *
+ * @param frame - The frame
+ * @param length - The length of the frame
+ * @param l2cap - If it arrived on the L2CAP channel
+ */
+void receiveFrame(const uint8_t *frame, size_t length, bool l2cap) {
+    if (length < HEADER_SIZE) {
+        return;
+    }
+
+    const uint8_t phase = frame[0];
+    if (phase == END_OF_PHASE) {
+        const uint8_t ended = frame[1] % PHASE_COUNT;
+        const StreamTally &tally = tallies[ended];
+        if (tally.frames > 1) {
+            const float seconds = (tally.last - tally.first) / 1e6f;
+            Serial.printf("%-13s %6u frames, %5u lost, %8.1f kbit/s\n", PHASE_NAMES[ended],
+                          tally.frames, tally.lost, tally.bytes * 8 / seconds / 1000.0f);
+        }
+        return;
+    }
+
+    if (phase % 2 == 1) {
+        echoFrame(frame, length, l2cap);
+        return;
+    }
+
+    uint32_t sequence;
+    memcpy(&sequence, &frame[1], sizeof(sequence));
+    StreamTally &tally = tallies[phase % PHASE_COUNT];
+    tally.last = micros();
+    if (tally.frames++ == 0) {
+        tally.first = tally.last;
+    }
+    tally.bytes += length;
+    tally.lost += sequence > tally.nextSequence ? sequence - tally.nextSequence : 0;
+    tally.nextSequence = sequence + 1;
+}
+
+/**
+ * Called for events on the L2CAP channel, on both sides
+ *
+ * @param event - The event
+ * @param arg - Unused
+ * @return 0 to accept the channel
+ */
+int l2capEvent(ble_l2cap_event *event, void *arg) {
+    switch (event->type) {
+        case BLE_L2CAP_EVENT_COC_ACCEPT:
+            return readyNextSdu(event->accept.chan, FRAME_SIZE);
+        case BLE_L2CAP_EVENT_COC_CONNECTED:
+            if (event->connect.status == 0) {
+                channel = event->connect.chan;
+                xSemaphoreGive(ready);
+            } else {
+                Serial.printf("L2CAP channel failed (code %d)\n", event->connect.status);
+            }
+            break;
+        case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+            channel = nullptr;
+            break;
+        case BLE_L2CAP_EVENT_COC_TX_UNSTALLED:
+            xSemaphoreGive(unstalled);
+            break;
+        case BLE_L2CAP_EVENT_COC_DATA_RECEIVED: {
+            os_mbuf *sdu = event->receive.sdu_rx;
+            uint8_t frame[FRAME_SIZE];
+            const uint16_t length = min(OS_MBUF_PKTLEN(sdu), FRAME_SIZE);
+            os_mbuf_copydata(sdu, 0, length, frame);
+            if (ROLE == Role::RECEIVER) {
+                receiveFrame(frame, length, true);
+            } else {
+                recordEcho(frame);
+            }
+            os_mbuf_free_chain(sdu);
+            if (readyNextSdu(event->receive.chan, FRAME_SIZE) != 0) {
+                Serial.println("No L2CAP receive buffer - closing the channel");
+                ble_l2cap_disconnect(event->receive.chan);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/**
+ * Sender callbacks - start the phases once the receiver subscribes, and time echoes
+ */
+struct SenderCallbacks final : public NimBLEServerCallbacks, public NimBLECharacteristicCallbacks {
+    void onConnect(NimBLEServer *server, NimBLEConnInfo &connInfo) override {
+        connHandle = connInfo.getConnHandle();
+        server->updateConnParams(connHandle, CONNECTION_INTERVAL, CONNECTION_INTERVAL, 0, 100);
+        server->setDataLen(connHandle, 251);
+    }
+
+    void onDisconnect(NimBLEServer *server, NimBLEConnInfo &connInfo, int reason) override {
+        Serial.printf("Disconnected (code %d)\n", reason);
+        ESP.restart();
+    }
+
+    void onSubscribe(NimBLECharacteristic *characteristic, NimBLEConnInfo &connInfo,
+                     uint16_t subValue) override {
+        if (subValue != 0) {
+            xSemaphoreGive(ready);
+        }
+    }
+
+    void onWrite(NimBLECharacteristic *characteristic, NimBLEConnInfo &connInfo) override {
+        const NimBLEAttValue value = characteristic->getValue();
+        if (value.length() >= HEADER_SIZE) {
+            recordEcho(value.data());
+        }
+    }
+} senderCallbacks;
+
+/**
+ * Receiver callbacks - start over if the link drops
+ */
+struct ReceiverCallbacks final : public NimBLEClientCallbacks {
+    void onDisconnect(NimBLEClient *client, int reason) override {
+        Serial.printf("Disconnected (code %d)\n", reason);
+        ESP.restart();
+    }
+} receiverCallbacks;
+
+/**
+ * Sender - stream frames over a phase's transport for STREAM_TIME
+ *
+ * @param phase - The phase
+ */
+void runStream(uint8_t phase) {
+    uint8_t frame[FRAME_SIZE]{};
+    uint32_t sent = 0, retries = 0;
+    const uint32_t start = millis();
+    while (millis() - start < STREAM_TIME) {
+        writeHeader(frame, phase, sent++);
+        retries += sendFrame(phase, frame, FRAME_SIZE);
+    }
+
+    Serial.printf("%-13s %6u frames sent, %6u retries\n", PHASE_NAMES[phase], sent, retries);
+}
+
+/**
+ * Sender - ping the receiver over a phase's transport PING_COUNT times
+ *
+ * @param phase - The phase
+ */
+void runPing(uint8_t phase) {
+    uint8_t frame[HEADER_SIZE];
+    uint32_t answered = 0, total = 0, fastest = UINT32_MAX, slowest = 0;
+    for (uint32_t i(0); i < PING_COUNT; ++i) {
+        xSemaphoreTake(echoed, 0);
+        writeHeader(frame, phase, i);
+        sendFrame(phase, frame, sizeof(frame));
+        if (xSemaphoreTake(echoed, pdMS_TO_TICKS(PING_TIMEOUT)) == pdTRUE && lastEcho == i) {
+            ++answered;
+            total += lastRoundTrip;
+            fastest = min(fastest, static_cast<uint32_t>(lastRoundTrip));
+            slowest = max(slowest, static_cast<uint32_t>(lastRoundTrip));
+        }
+        delay(PING_GAP);
+    }
+
+    if (answered == 0) {
+        Serial.printf("%-13s no pings answered\n", PHASE_NAMES[phase]);
+        return;
+    }
+
+    Serial.printf("%-13s %3u/%u answered, round trip %6u min %6u mean %6u max us\n",
+                  PHASE_NAMES[phase], answered, PING_COUNT, fastest, total / answered, slowest);
+}
+
+/**
+ * Sender - tell the receiver a phase is over
+ *
+ * @param phase - The phase
+ */
+void endPhase(uint8_t phase) {
+    // Give queued frames time to land first
+    delay(500);
+    uint8_t frame[HEADER_SIZE];
+    writeHeader(frame, END_OF_PHASE, 0);
+    frame[1] = phase;
+    sendFrame(END_OF_PHASE, frame, sizeof(frame));
+}
+
+/**
+ * Sender - advertise, wait for the receiver, then run every phase
+ */
+void runSender() {
+    NimBLEServer *server = NimBLEDevice::createServer();
+    server->setCallbacks(&senderCallbacks, false);
+    NimBLEService *service = server->createService(SERVICE_UUID);
+    dataCharacteristic = service->createCharacteristic(DATA_UUID, NIMBLE_PROPERTY::NOTIFY);
+    dataCharacteristic->setCallbacks(&senderCallbacks);
+    NimBLECharacteristic *echo = service->createCharacteristic(ECHO_UUID,
+                                                               NIMBLE_PROPERTY::WRITE_NR);
+    echo->setCallbacks(&senderCallbacks);
+    service->start();
+    NimBLEDevice::getAdvertising()->addServiceUUID(SERVICE_UUID);
+    NimBLEDevice::startAdvertising();
+    Serial.println("Advertising - waiting for the receiver");
+
+    xSemaphoreTake(ready, portMAX_DELAY);
+    delay(1000);    // Let the parameter updates settle
+    if (ble_l2cap_connect(connHandle, PSM, FRAME_SIZE, os_msys_get_pkthdr(FRAME_SIZE, 0),
+                          l2capEvent, nullptr) != 0 ||
+        xSemaphoreTake(ready, pdMS_TO_TICKS(5000)) != pdTRUE) {
+        Serial.println("No L2CAP channel - check CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM");
+        return;
+    }
+
+    for (uint8_t phase(0); phase < PHASE_COUNT; ++phase) {
+        if (phase % 2 == 0) {
+            runStream(phase);
+        } else {
+            runPing(phase);
+        }
+        endPhase(phase);
+    }
+    Serial.println("Done");
+}
+
+/**
+ * Receiver - listen for the channel, find the sender and subscribe
+ */
+void runReceiver() {
+    if (ble_l2cap_create_server(PSM, FRAME_SIZE, l2capEvent, nullptr) != 0) {
+        Serial.println("Cannot listen for L2CAP - check CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM");
+        return;
+    }
+
+    Serial.println("Scanning for the sender");
+    NimBLEAddress sender;
+    bool found = false;
+    while (!found) {
+        NimBLEScanResults results = NimBLEDevice::getScan()->getResults(2000, false);
+        for (int i(0); i < results.getCount(); ++i) {
+            NimBLEAdvertisedDevice device = results.getDevice(i);
+            if (device.isAdvertisingService(NimBLEUUID(SERVICE_UUID))) {
+                sender = device.getAddress();
+                found = true;
+            }
+        }
+    }
+
+    NimBLEClient *client = NimBLEDevice::createClient();
+    client->setClientCallbacks(&receiverCallbacks, false);
+    client->setConnectionParams(CONNECTION_INTERVAL, CONNECTION_INTERVAL, 0, 100);
+    if (!client->connect(sender)) {
+        Serial.println("Failed to connect");
+        return;
+    }
+    client->setDataLen(251);
+
+    NimBLERemoteService *service = client->getService(SERVICE_UUID);
+    if (service == nullptr) {
+        Serial.println("Sender service not found");
+        return;
+    }
+    echoCharacteristic = service->getCharacteristic(ECHO_UUID);
+    NimBLERemoteCharacteristic *data = service->getCharacteristic(DATA_UUID);
+    if (echoCharacteristic == nullptr || data == nullptr ||
+        !data->subscribe(true, [](NimBLERemoteCharacteristic *, uint8_t *frame, size_t length,
+                                  bool) { receiveFrame(frame, length, false); })) {
+        Serial.println("Failed to subscribe");
+        return;
+    }
+    Serial.println("Connected - results follow each phase");
+}
+
+void setup() {
+    Serial.begin(BAUD_RATE);
+    ready = xSemaphoreCreateBinary();
+    unstalled = xSemaphoreCreateBinary();
+    echoed = xSemaphoreCreateBinary();
+
+    NimBLEDevice::init(ROLE == Role::SENDER ? "L2CAP sender" : "L2CAP receiver");
+    NimBLEDevice::setMTU(FRAME_SIZE + 3);
+    if (ROLE == Role::SENDER) {
+        runSender();
+    } else {
+        runReceiver();
+    }
+}
+
+void loop() {}
@@ -0,0 +1,215 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "..\lib\I2Cdev\I2Cdev.h"
+#include "..\lib\MPU6050\MPU6050_6Axis_MotionApps20.h"
+#include "server/orientationFilter.h"
+
+/*
+ * Benchmarks the server's RAW mode orientation filters and compares them against the DMP.
+ *
+ * The first part needs no IMU. It times each filter's update and checks it against synthetic
+ * motion: convergence to a static tilt and integration of a constant rate.
+ *
+ * The second part needs the IMU wired as in server/server.cpp. It runs the DMP and feeds the raw
+ * samples to both filters at the same time, then reports how far each filter's tilt is from the
+ * DMP's. Move the IMU around while it runs. Yaw is left out, since without a magnetometer both
+ * sides drift in yaw independently. The DMP sets the sample rate, so the filters run at 200 Hz
+ * here rather than RAW mode's 1 kHz
+ */
+
+// Configuration variables - set these to size the tests
+constexpr size_t SAMPLES = 1000;
+constexpr float MADGWICK_BETA = 0.1f;
+constexpr float MAHONY_KP = 1.0f;
+constexpr float MAHONY_KI = 0.0f;
+constexpr float TILT_TOLERANCE = 0.5f;      // Max static tilt error in deg after converging
+constexpr float RATE_TOLERANCE = 0.5f;      // Max yaw error in deg after 1 s at 1 rad/s
+constexpr float DMP_TOLERANCE = 3.0f;       // Max mean tilt difference from the DMP in deg
+constexpr uint32_t CLOCK = 400000;          // Clock for the I2C bus in Hz
+constexpr uint32_t WARMUP_TIME = 3000;      // ms to let the filters converge before comparing
+constexpr uint32_t COMPARE_TIME = 30000;    // ms to compare against the DMP
+constexpr uint32_t RAW_PERIOD = 5000;       // us between raw samples (the DMP's 200 Hz)
+constexpr uint32_t BAUD_RATE = 115200;
+
+// Program variables
+constexpr float DEGREES_PER_RADIAN = 180.0f / 3.14159265f;
+constexpr float GYRO_SCALE = 1.0f / (DEGREES_PER_RADIAN * 16.4f);   // rad/s per LSB at 2000 deg/s
+MPU6050 mpu;
+float gyroSamples[SAMPLES][3];
+float accelSamples[SAMPLES][3];
+volatile float sink; // Keeps the benchmarked results alive
+
+/**
+ * Get a random float in [-1, 1)
+ *
+ * @return The random float
+ */
+float randomUnit() { return random(-100000, 100000) / 100000.0f; }
+
+/**
+ * Print the result of a tolerance check
+ *
+ * @param name - The name of the check
+ * @param error - The error seen
+ * @param tolerance - The allowed error
+ */
+void check(const char *name, float error, float tolerance) {
+    Serial.printf("%-28s error: %8.4f deg\t%s\n", name, error, error <= tolerance ? "PASS" :
+                                                                "FAIL");
+}
+
+/**
+ * Get the angle between the gravity vectors of two orientations
+ *
+ * @param a - The first quaternion {w, x, y, z}
+ * @param b - The second quaternion {w, x, y, z}
+ * @return The tilt difference in deg
+ */
+float tiltError(const std::array<float, 4> &a, const std::array<float, 4> &b) {
+    const float ax = 2.0f * (a[1] * a[3] - a[0] * a[2]);
+    const float ay = 2.0f * (a[0] * a[1] + a[2] * a[3]);
+    const float az = a[0] * a[0] - a[1] * a[1] - a[2] * a[2] + a[3] * a[3];
+    const float bx = 2.0f * (b[1] * b[3] - b[0] * b[2]);
+    const float by = 2.0f * (b[0] * b[1] + b[2] * b[3]);
+    const float bz = b[0] * b[0] - b[1] * b[1] - b[2] * b[2] + b[3] * b[3];
+    return acosf(constrain(ax * bx + ay * by + az * bz, -1.0f, 1.0f)) * DEGREES_PER_RADIAN;
+}
+
+/**
+ * Time a filter's update and check it against synthetic motion
+ *
+ * @param name - The name of the filter
+ * @param filter - The filter
+ */
+void benchmark(const char *name, OrientationFilter &filter) {
+    // Cycles - update with noisy samples
+    filter.reset();
+    const uint32_t start = ESP.getCycleCount();
+    for (size_t i(0); i < SAMPLES; ++i) {
+        filter.update(gyroSamples[i][0], gyroSamples[i][1], gyroSamples[i][2],
+                      accelSamples[i][0], accelSamples[i][1], accelSamples[i][2], 0.001f);
+        sink = filter.getQuaternion()[0];
+    }
+    const uint32_t cycles = ESP.getCycleCount() - start;
+    Serial.printf("%-28s %7.1f cyc\t%6.2f us per update\n", name,
+                  cycles / static_cast<float>(SAMPLES),
+                  cycles / static_cast<float>(SAMPLES) / ESP.getCpuFreqMHz());
+
+    // Accuracy - converge to a static 30 deg tilt about x
+    const float tilt = 30.0f / DEGREES_PER_RADIAN;
+    filter.reset();
+    for (uint16_t i(0); i < 10000; ++i) {
+        filter.update(0.0f, 0.0f, 0.0f, 0.0f, sinf(tilt), cosf(tilt), 0.001f);
+    }
+    const std::array<float, 4> expected = {cosf(tilt / 2.0f), sinf(tilt / 2.0f), 0.0f, 0.0f};
+    check("  static tilt", tiltError(filter.getQuaternion(), expected), TILT_TOLERANCE);
+
+    // Accuracy - integrate 1 rad/s of yaw for 1 s while level
+    filter.reset();
+    for (uint16_t i(0); i < 1000; ++i) {
+        filter.update(0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.001f);
+    }
+    const std::array<float, 4> &q = filter.getQuaternion();
+    check("  yaw rate", fabsf(2.0f * atan2f(q[3], q[0]) - 1.0f) * DEGREES_PER_RADIAN,
+          RATE_TOLERANCE);
+}
+
+/**
+ * Run the DMP and both filters on the same motion and compare their tilt
+ *
+ * @param madgwick - The Madgwick filter
+ * @param mahony - The Mahony filter
+ */
+void compareWithDMP(OrientationFilter &madgwick, OrientationFilter &mahony) {
+    Wire.begin();
+    Wire.setClock(CLOCK);
+    mpu.initialize();
+    if (!mpu.testConnection() || mpu.dmpInitialize() != 0) {
+        Serial.println("No IMU or DMP - skipping the DMP comparison");
+        return;
+    }
+
+    Serial.println("Calibrating - keep the IMU still and level");
+    mpu.CalibrateAccel();
+    mpu.CalibrateGyro();
+    mpu.setDMPEnabled(true);
+    mpu.resetFIFO();
+    madgwick.reset();
+    mahony.reset();
+    Serial.printf("Comparing with the DMP for %d s - move the IMU around\n",
+                  static_cast<int>(COMPARE_TIME / 1000));
+
+    uint8_t packet[42];
+    Quaternion dmp;
+    int16_t ax, ay, az, gx, gy, gz;
+    float madgwickSum(0.0f), mahonySum(0.0f), madgwickMax(0.0f), mahonyMax(0.0f);
+    uint32_t compared = 0;
+    const uint32_t begin = millis();
+    uint32_t prevRaw = micros();
+
+    while (millis() - begin < WARMUP_TIME + COMPARE_TIME) {
+        const uint32_t now = micros();
+        if (now - prevRaw >= RAW_PERIOD) {
+            const float dt = (now - prevRaw) * 1e-6f;
+            prevRaw = now;
+            mpu.getMotion6(&ax, &ay, &az, &gx, &gy, &gz);
+            madgwick.update(gx * GYRO_SCALE, gy * GYRO_SCALE, gz * GYRO_SCALE, ax, ay, az, dt);
+            mahony.update(gx * GYRO_SCALE, gy * GYRO_SCALE, gz * GYRO_SCALE, ax, ay, az, dt);
+        }
+
+        if (!mpu.dmpGetCurrentFIFOPacket(packet)) {
+            continue;
+        }
+
+        mpu.dmpGetQuaternion(&dmp, packet);
+        if (millis() - begin < WARMUP_TIME) {
+            continue;
+        }
+
+        const std::array<float, 4> reference = {dmp.w, dmp.x, dmp.y, dmp.z};
+        const float madgwickError = tiltError(madgwick.getQuaternion(), reference);
+        const float mahonyError = tiltError(mahony.getQuaternion(), reference);
+        madgwickSum += madgwickError;
+        mahonySum += mahonyError;
+        madgwickMax = max(madgwickMax, madgwickError);
+        mahonyMax = max(mahonyMax, mahonyError);
+        ++compared;
+    }
+
+    if (compared == 0) {
+        Serial.println("No DMP packets were read");
+        return;
+    }
+
+    Serial.printf("Compared %d DMP packets\n", static_cast<int>(compared));
+    Serial.printf("Madgwick max tilt difference: %8.4f deg\n", madgwickMax);
+    Serial.printf("Mahony max tilt difference:   %8.4f deg\n", mahonyMax);
+    check("Madgwick mean vs DMP", madgwickSum / compared, DMP_TOLERANCE);
+    check("Mahony mean vs DMP", mahonySum / compared, DMP_TOLERANCE);
+}
+
+void setup() {
+    Serial.begin(BAUD_RATE);
+
+    // Gyro near rest and gravity along z, both with noise
+    for (size_t i(0); i < SAMPLES; ++i) {
+        for (uint8_t axis(0); axis < 3; ++axis) {
+            gyroSamples[i][axis] = 0.05f * randomUnit();
+            accelSamples[i][axis] = 0.05f * randomUnit();
+        }
+        accelSamples[i][2] += 1.0f;
+    }
+
+    OrientationFilter madgwick(OrientationFilter::Type::MADGWICK, MADGWICK_BETA);
+    OrientationFilter mahony(OrientationFilter::Type::MAHONY, MAHONY_KP, MAHONY_KI);
+    benchmark("Madgwick", madgwick);
+    benchmark("Mahony", mahony);
+
+    compareWithDMP(madgwick, mahony);
+}
+
+void loop() {}
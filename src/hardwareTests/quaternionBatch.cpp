@@ -0,0 +1,207 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include <Arduino.h>
+#include "control/extendedQuaternion.h"
+#include "control/quaternionBatch.h"
+
+// Configuration variables - set these to size the benchmark
+constexpr size_t BATCH_SIZE = 256;
+constexpr uint8_t REPETITIONS = 10;
+constexpr float SLERP_TOLERANCE = 1e-4f;    // Max component error between the two slerps
+constexpr uint32_t BAUD_RATE = 115200;
+
+// Program variables
+float lhsData[4][BATCH_SIZE];
+float rhsData[4][BATCH_SIZE];
+float outData[4][BATCH_SIZE];
+float vectorData[3][BATCH_SIZE];
+float rotatedData[3][BATCH_SIZE];
+float dotData[BATCH_SIZE];
+Quaternion lhsObjects[BATCH_SIZE];
+Quaternion rhsObjects[BATCH_SIZE];
+Quaternion outObjects[BATCH_SIZE];
+VectorFloat vectorObjects[BATCH_SIZE];
+VectorFloat rotatedObjects[BATCH_SIZE];
+ExtendedQuaternion slerpObjects[BATCH_SIZE];
+
+const QuaternionArray lhs{lhsData[0], lhsData[1], lhsData[2], lhsData[3]};
+const QuaternionArray rhs{rhsData[0], rhsData[1], rhsData[2], rhsData[3]};
+const QuaternionArray out{outData[0], outData[1], outData[2], outData[3]};
+const VectorArray vectors{vectorData[0], vectorData[1], vectorData[2]};
+const VectorArray rotated{rotatedData[0], rotatedData[1], rotatedData[2]};
+
+/**
+ * Print the average cycles per quaternion for both APIs
+ *
+ * @param name - The name of the operation
+ * @param objectCycles - Total cycles taken by the per-object API
+ * @param batchCycles - Total cycles taken by the batch kernel
+ */
+void report(const char *name, uint32_t objectCycles, uint32_t batchCycles) {
+    const float scale = 1.0f / (BATCH_SIZE * REPETITIONS);
+    Serial.printf("%-10s object: %7.1f cyc/q\tbatch: %7.1f cyc/q\tspeedup: %.2fx\n", name,
+                  objectCycles * scale, batchCycles * scale,
+                  static_cast<float>(objectCycles) / batchCycles);
+}
+
+/**
+ * Slerp one pair of unit quaternions with the per-object API: from * exp(t * log(conj(from) * to))
+ * along the shorter arc
+ *
+ * @param from - The quaternion at t = 0
+ * @param to - The quaternion at t = 1
+ * @param t - The interpolation parameter [0, 1]
+ * @return The interpolated quaternion
+ */
+ExtendedQuaternion slerpObject(const Quaternion &from, const Quaternion &to, float t) {
+    const ExtendedQuaternion start(from);
+    ExtendedQuaternion delta = start.conjugate() * ExtendedQuaternion(to);
+    if (delta.w < 0.0f) {
+        delta = -delta;
+    }
+
+    const VectorFloat halfAngle = delta.log();
+    return start * ExtendedQuaternion::exp({halfAngle.x * t, halfAngle.y * t, halfAngle.z * t});
+}
+
+/**
+ * Fill both layouts with the same random unit quaternions and vectors
+ */
+void fill() {
+    for (size_t i(0); i < BATCH_SIZE; ++i) {
+        lhsObjects[i] = Quaternion(random(-1000, 1000), random(-1000, 1000), random(-1000, 1000),
+                                   random(-1000, 1000)).getNormalized();
+        rhsObjects[i] = Quaternion(random(-1000, 1000), random(-1000, 1000), random(-1000, 1000),
+                                   random(-1000, 1000)).getNormalized();
+        vectorObjects[i] = VectorFloat(random(-1000, 1000), random(-1000, 1000),
+                                       random(-1000, 1000));
+
+        lhs.w[i] = lhsObjects[i].w;
+        lhs.x[i] = lhsObjects[i].x;
+        lhs.y[i] = lhsObjects[i].y;
+        lhs.z[i] = lhsObjects[i].z;
+        rhs.w[i] = rhsObjects[i].w;
+        rhs.x[i] = rhsObjects[i].x;
+        rhs.y[i] = rhsObjects[i].y;
+        rhs.z[i] = rhsObjects[i].z;
+        vectors.x[i] = vectorObjects[i].x;
+        vectors.y[i] = vectorObjects[i].y;
+        vectors.z[i] = vectorObjects[i].z;
+    }
+}
+
+void setup() {
+    Serial.begin(BAUD_RATE);
+    fill();
+
+    uint32_t objectCycles(0), batchCycles(0), start;
+
+    // Multiply
+    for (uint8_t r(0); r < REPETITIONS; ++r) {
+        start = ESP.getCycleCount();
+        for (size_t i(0); i < BATCH_SIZE; ++i) {
+            outObjects[i] = lhsObjects[i].getProduct(rhsObjects[i]);
+        }
+        objectCycles += ESP.getCycleCount() - start;
+
+        start = ESP.getCycleCount();
+        QuaternionBatch::multiply(lhs, rhs, out, BATCH_SIZE);
+        batchCycles += ESP.getCycleCount() - start;
+    }
+    report("multiply", objectCycles, batchCycles);
+
+    // Conjugate
+    objectCycles = batchCycles = 0;
+    for (uint8_t r(0); r < REPETITIONS; ++r) {
+        start = ESP.getCycleCount();
+        for (size_t i(0); i < BATCH_SIZE; ++i) {
+            outObjects[i] = lhsObjects[i].getConjugate();
+        }
+        objectCycles += ESP.getCycleCount() - start;
+
+        start = ESP.getCycleCount();
+        QuaternionBatch::conjugate(lhs, out, BATCH_SIZE);
+        batchCycles += ESP.getCycleCount() - start;
+    }
+    report("conjugate", objectCycles, batchCycles);
+
+    // Normalize
+    objectCycles = batchCycles = 0;
+    for (uint8_t r(0); r < REPETITIONS; ++r) {
+        start = ESP.getCycleCount();
+        for (size_t i(0); i < BATCH_SIZE; ++i) {
+            outObjects[i].normalize();
+        }
+        objectCycles += ESP.getCycleCount() - start;
+
+        start = ESP.getCycleCount();
+        QuaternionBatch::normalize(out, BATCH_SIZE);
+        batchCycles += ESP.getCycleCount() - start;
+    }
+    report("normalize", objectCycles, batchCycles);
+
+    // Rotate
+    objectCycles = batchCycles = 0;
+    for (uint8_t r(0); r < REPETITIONS; ++r) {
+        start = ESP.getCycleCount();
+        for (size_t i(0); i < BATCH_SIZE; ++i) {
+            rotatedObjects[i] = vectorObjects[i].getRotated(&lhsObjects[i]);
+        }
+        objectCycles += ESP.getCycleCount() - start;
+
+        start = ESP.getCycleCount();
+        QuaternionBatch::rotate(lhs, vectors, rotated, BATCH_SIZE);
+        batchCycles += ESP.getCycleCount() - start;
+    }
+    report("rotate", objectCycles, batchCycles);
+
+    // Dot
+    objectCycles = batchCycles = 0;
+    for (uint8_t r(0); r < REPETITIONS; ++r) {
+        start = ESP.getCycleCount();
+        for (size_t i(0); i < BATCH_SIZE; ++i) {
+            const ExtendedQuaternion q(lhsObjects[i].w, lhsObjects[i].x, lhsObjects[i].y,
+                                       lhsObjects[i].z);
+            dotData[i] = q.dot(rhsObjects[i]);
+        }
+        objectCycles += ESP.getCycleCount() - start;
+
+        start = ESP.getCycleCount();
+        QuaternionBatch::dot(lhs, rhs, dotData, BATCH_SIZE);
+        batchCycles += ESP.getCycleCount() - start;
+    }
+    report("dot", objectCycles, batchCycles);
+
+    // Slerp - the per-object version goes through log and exp
+    objectCycles = batchCycles = 0;
+    for (uint8_t r(0); r < REPETITIONS; ++r) {
+        start = ESP.getCycleCount();
+        for (size_t i(0); i < BATCH_SIZE; ++i) {
+            slerpObjects[i] = slerpObject(lhsObjects[i], rhsObjects[i], 0.5f);
+        }
+        objectCycles += ESP.getCycleCount() - start;
+
+        start = ESP.getCycleCount();
+        QuaternionBatch::slerp(lhs, rhs, 0.5f, out, BATCH_SIZE);
+        batchCycles += ESP.getCycleCount() - start;
+    }
+    report("slerp", objectCycles, batchCycles);
+
+    // Both slerps must land on the same quaternion, up to sign
+    float error(0.0f);
+    for (size_t i(0); i < BATCH_SIZE; ++i) {
+        const float sign = slerpObjects[i].w * out.w[i] + slerpObjects[i].x * out.x[i] +
+                           slerpObjects[i].y * out.y[i] + slerpObjects[i].z * out.z[i] < 0.0f ?
+                           -1.0f : 1.0f;
+        error = max(error, fabsf(slerpObjects[i].w - sign * out.w[i]) +
+                           fabsf(slerpObjects[i].x - sign * out.x[i]) +
+                           fabsf(slerpObjects[i].y - sign * out.y[i]) +
+                           fabsf(slerpObjects[i].z - sign * out.z[i]));
+    }
+    Serial.printf("%-10s max error: %e\t%s\n", "slerp", error,
+                  error <= SLERP_TOLERANCE ? "PASS" : "FAIL");
+}
+
+void loop() {}
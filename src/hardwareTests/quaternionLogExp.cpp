@@ -0,0 +1,146 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include <Arduino.h>
+#include "control/extendedQuaternion.h"
+
+// Configuration variables - set these to size the tests
+constexpr size_t SAMPLES = 1000;
+constexpr float ROUND_TRIP_TOLERANCE = 2e-5f;   // Max error of exp(log(q)) against q
+constexpr float VELOCITY_TOLERANCE = 1e-4f;     // Max relative error of recovered rates
+constexpr float SLOW_VELOCITY_TOLERANCE = 1e-2f;    // As above for rotations of ~1e-4 rad per
+                                                    // step, where float rounding dominates
+constexpr uint32_t BAUD_RATE = 115200;
+
+// Program variables
+ExtendedQuaternion quaternions[SAMPLES];
+VectorFloat logs[SAMPLES];
+volatile float sink; // Keeps the benchmarked results alive
+
+/**
+ * Get a random float in [-1, 1)
+ *
+ * @return The random float
+ */
+float randomUnit() { return random(-100000, 100000) / 100000.0f; }
+
+/**
+ * Print the result of a tolerance check
+ *
+ * @param name - The name of the check
+ * @param error - The worst error seen
+ * @param tolerance - The allowed error
+ */
+void check(const char *name, float error, float tolerance) {
+    Serial.printf("%-28s max error: %e\t%s\n", name, error, error <= tolerance ? "PASS" : "FAIL");
+}
+
+/**
+ * Get the largest component-wise difference between two quaternions
+ *
+ * @param a
+ * @param b
+ * @return The difference
+ */
+float difference(const ExtendedQuaternion &a, const ExtendedQuaternion &b) {
+    return max(max(fabsf(a.w - b.w), fabsf(a.x - b.x)), max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+}
+
+/**
+ * Recover a known angular velocity from two orientations one step apart and get the relative
+ * error
+ *
+ * @param axis - The unit rotation axis
+ * @param rate - The rotation rate in rad/s
+ * @param dt - The time step in seconds
+ * @return The relative error of the recovered angular velocity
+ */
+float velocityError(const VectorFloat &axis, float rate, float dt) {
+    const ExtendedQuaternion from(randomUnit(), randomUnit(), randomUnit(), randomUnit());
+    const ExtendedQuaternion start = from.normalized();
+    const ExtendedQuaternion end = start * ExtendedQuaternion::exp({0.5f * rate * dt * axis.x,
+                                                                    0.5f * rate * dt * axis.y,
+                                                                    0.5f * rate * dt * axis.z});
+    const VectorFloat w = ExtendedQuaternion::angularVelocity(start, end, dt);
+    return (fabsf(w.x - rate * axis.x) + fabsf(w.y - rate * axis.y) + fabsf(w.z - rate * axis.z)) /
+           rate;
+}
+
+void setup() {
+    Serial.begin(BAUD_RATE);
+
+    for (ExtendedQuaternion &q : quaternions) {
+        q = ExtendedQuaternion(randomUnit(), randomUnit(), randomUnit(), randomUnit())
+                .normalized();
+        if (q.w < 0.0f) {
+            q = -q;
+        }
+    }
+
+    // Tolerance - exp(log(q)) round trip for general rotations
+    float error(0.0f);
+    for (const ExtendedQuaternion &q : quaternions) {
+        error = max(error, difference(ExtendedQuaternion::exp(q.log()), q));
+    }
+    check("round trip", error, ROUND_TRIP_TOLERANCE);
+
+    // Tolerance - round trip near identity, across the Taylor threshold
+    error = 0.0f;
+    for (float angle(1e-7f); angle < 1e-1f; angle *= 1.1f) {
+        const ExtendedQuaternion q = ExtendedQuaternion::fromAxisAngle({0.0f, 0.6f, 0.8f}, angle);
+        error = max(error, difference(ExtendedQuaternion::exp(q.log()), q));
+    }
+    check("round trip (near identity)", error, ROUND_TRIP_TOLERANCE);
+
+    // Tolerance - angular velocity at control loop rates, fast and slow
+    error = 0.0f;
+    float slowError(0.0f);
+    for (size_t i(0); i < SAMPLES; ++i) {
+        VectorFloat axis(randomUnit(), randomUnit(), randomUnit());
+        axis.normalize();
+        error = max(error, velocityError(axis, 10.0f, 0.01f));
+        slowError = max(slowError, velocityError(axis, 0.01f, 0.01f));
+    }
+    check("angular velocity", error, VELOCITY_TOLERANCE);
+    check("angular velocity (slow)", slowError, SLOW_VELOCITY_TOLERANCE);
+
+    // Tolerance - the sign ambiguity of q and -q must not flip the result
+    error = 0.0f;
+    for (size_t i(1); i < SAMPLES; ++i) {
+        const VectorFloat a = ExtendedQuaternion::angularVelocity(quaternions[i - 1],
+                                                                  quaternions[i], 0.01f);
+        const VectorFloat b = ExtendedQuaternion::angularVelocity(quaternions[i - 1],
+                                                                  -quaternions[i], 0.01f);
+        error = max(error, fabsf(a.x - b.x) + fabsf(a.y - b.y) + fabsf(a.z - b.z));
+    }
+    check("angular velocity (-q)", error, VELOCITY_TOLERANCE);
+
+    // Tolerance - -1 has no axis and must log to zero, not NaN
+    const VectorFloat negative = ExtendedQuaternion(-1.0f, 0.0f, 0.0f, 0.0f).log();
+    check("log(-1)", fabsf(negative.x) + fabsf(negative.y) + fabsf(negative.z), 0.0f);
+
+    // Cycles
+    uint32_t start = ESP.getCycleCount();
+    for (size_t i(0); i < SAMPLES; ++i) {
+        logs[i] = quaternions[i].log();
+    }
+    uint32_t cycles = ESP.getCycleCount() - start;
+    Serial.printf("%-28s %7.1f cyc\n", "log", cycles / static_cast<float>(SAMPLES));
+
+    start = ESP.getCycleCount();
+    for (const VectorFloat &v : logs) {
+        sink = ExtendedQuaternion::exp(v).w;
+    }
+    cycles = ESP.getCycleCount() - start;
+    Serial.printf("%-28s %7.1f cyc\n", "exp", cycles / static_cast<float>(SAMPLES));
+
+    start = ESP.getCycleCount();
+    for (size_t i(1); i < SAMPLES; ++i) {
+        sink = ExtendedQuaternion::angularVelocity(quaternions[i - 1], quaternions[i], 0.01f).x;
+    }
+    cycles = ESP.getCycleCount() - start;
+    Serial.printf("%-28s %7.1f cyc\n", "angularVelocity", cycles / static_cast<float>(SAMPLES - 1));
+}
+
+void loop() {}
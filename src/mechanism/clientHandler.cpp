@@ -1,17 +1,43 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 01/30/25
+// Last Modified: 10/18/2026
 
 #include "mechanism/clientHandler.h"
+#include "mechanism/connectionPolicy.h"
+#include "common/l2capSdu.h"
+
+namespace {
+constexpr int32_t AGE_FLOOR_LEAK = 1;   // us the age floor rises per packet. Faster than the two
+                                        // crystals can drift apart, so a slower server clock does
+                                        // not inflate ages over time
+constexpr uint32_t STATS_LOG_INTERVAL = 5000;   // ms between stream statistics logs
+constexpr uint16_t SYNC_TIMEOUT = 100;  // Periodic advertising sync timeout in 10 ms units (1 s)
+constexpr uint32_t CONNECT_TIMEOUT = 5000;  // ms to connect to a server found by a scan
+constexpr uint32_t HOUSEKEEPING_INTERVAL = 250; // Most ms the loop waits for an event before
+                                                // logging statistics and evaluating the connection
+constexpr uint32_t MIN_BACKOFF = 250;   // ms before scanning again after the first failure
+constexpr uint32_t MAX_BACKOFF = 4000;  // Most ms before scanning again, doubling per failure
+constexpr UBaseType_t EVENT_QUEUE_LENGTH = 8;   // Link events that can wait for the loop
+constexpr UBaseType_t LINK_LOSS_RESERVE = 2;    // Queue slots only link loss events may take
+constexpr const char *LINK_STATE_NAMES[] = {"idle", "scanning", "connecting", "discovering",
+                                            "subscribed", "backoff"};
+static_assert(sizeof(LINK_STATE_NAMES) / sizeof(LINK_STATE_NAMES[0]) ==
+              static_cast<size_t>(LinkState::COUNT), "Every LinkState needs a name");
+}
 
 void ClientCallbacks::onConnect(NimBLEClient *connectedClient) {
     Log.infoln("Connected to the server");
-    connectedClient->updateConnParams(120, 120, 0, 60); //todo figure this out
+    ConnectionPolicy::onConnect(connectedClient);
 }
 
 void ClientCallbacks::onDisconnect(NimBLEClient *disconnectedClient, int reason) {
-    Log.warningln("Disconnected from the server (code %d). Starting scan", reason);
-    NimBLEDevice::getScan()->start(ClientHandler::scanTime);
+    Log.warningln("Disconnected from the server (code %d)", reason);
+    ConnectionPolicy::onDisconnect();
+
+    LinkEvent event;
+    event.type = LinkEventType::DISCONNECTED;
+    event.reason = reason;
+    ClientHandler::post(event);
 }
 
 //================================================================================================//
@@ -21,11 +47,30 @@ void ScanCallbacks::onResult(NimBLEAdvertisedDevice *advertisedDevice) {
     Log.traceln(advertisedDevice->toString().c_str());
 
     // Check if the device has the correct service UUID
-    if (advertisedDevice->isAdvertisingService(NimBLEUUID(ClientHandler::serviceUUID))) {
+    if (advertisedDevice->isAdvertisingService(ClientHandler::serviceID)) {
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+        // The server advertises the broadcast in its own set, with a periodic train
+        if (ClientHandler::link == ImuLink::BROADCAST) {
+            if (advertisedDevice->getSetId() == BROADCAST_SID &&
+                advertisedDevice->getPeriodicInterval() != 0) {
+                ClientHandler::syncToBroadcast(advertisedDevice);
+            }
+            return;
+        }
+#endif
         Log.traceln("Found a server with the correct service");
+
+        // Results keep coming until the scan stops, but the loop only needs the first
+        if (ClientHandler::serverFound.exchange(true)) {
+            return;
+        }
+
+        // The address is copied, since stopping the scan may free the scan results
+        LinkEvent event;
+        event.type = LinkEventType::SERVER_FOUND;
+        event.address = *advertisedDevice->getAddress().getBase();
+        ClientHandler::post(event);
         NimBLEDevice::getScan()->stop();
-        ClientHandler::advDevice = advertisedDevice;
-        ClientHandler::doConnect = true;
     }
 
     Log.traceln("onResult end");
@@ -33,21 +78,57 @@ void ScanCallbacks::onResult(NimBLEAdvertisedDevice *advertisedDevice) {
 
 void ScanCallbacks::onScanEnd(NimBLEScanResults results) {
     Log.traceln("ScanCallbacks::onScanEnd - Scan ended");
+    LinkEvent event;
+    event.type = LinkEventType::SCAN_ENDED;
+    ClientHandler::post(event);
 }
 
 //================================================================================================//
 
 // Set static variables
-NimBLEAdvertisedDevice *ClientHandler::advDevice = nullptr;
+NimBLEAddress ClientHandler::serverAddress;
 std::string ClientHandler::serviceUUID;
+NimBLEUUID ClientHandler::serviceID;
+ImuLink ClientHandler::link = ImuLink::CONNECTED;
+std::atomic<bool> ClientHandler::serverFound{false};
 uint32_t ClientHandler::scanTime = 5 * 1000;
-bool ClientHandler::doConnect = false;
 ClientHandler *ClientHandler::inst = nullptr;
 ClientCallbacks ClientHandler::clientCallback;
 ScanCallbacks ClientHandler::scanCallback;
 bool ClientHandler::initialized = false;
 std::string ClientHandler::IMUCharacteristicUUID;
-std::array <float, 4> ClientHandler::quaternion;
+std::string ClientHandler::controlCharacteristicUUID;
+ImuFormat ClientHandler::preferredFormat = ImuFormat::LEGACY;
+uint8_t ClientHandler::preferredFields = fieldBit(ImuField::QUATERNION);
+ImuTransport ClientHandler::preferredTransport = ImuTransport::NOTIFY;
+uint8_t ClientHandler::batchSize = 1;
+uint8_t ClientHandler::batchDelay = 0;
+NimBLERemoteCharacteristic *ClientHandler::remoteControlCharacteristic = nullptr;
+std::array<NotifyRoute, MAX_NOTIFY_ROUTES> ClientHandler::notifyRoutes;
+size_t ClientHandler::notifyRouteCount = 0;
+SeqLock<ClientSample> ClientHandler::latest;
+SampleRing<ClientSample, 32> ClientHandler::sampleRing;
+ImuStreamStats ClientHandler::stats;
+SeqLock<ImuStreamStats> ClientHandler::publishedStats;
+std::atomic<bool> ClientHandler::statsResetRequested{false};
+uint16_t ClientHandler::lastSequence = 0;
+bool ClientHandler::hasSequence = false;
+int32_t ClientHandler::ageFloor = 0;
+bool ClientHandler::hasAgeFloor = false;
+uint32_t ClientHandler::reconnectTimeout = 2000;
+QueueHandle_t ClientHandler::events = nullptr;
+LinkState ClientHandler::state = LinkState::IDLE;
+std::array<uint32_t, static_cast<size_t>(LinkState::COUNT)> ClientHandler::phaseTimes{};
+uint32_t ClientHandler::phaseStart = 0;
+uint32_t ClientHandler::backoff = MIN_BACKOFF;
+uint32_t ClientHandler::backoffEnd = 0;
+uint32_t ClientHandler::linkLostTime = 0;
+bool ClientHandler::awaitingSample = false;
+bool ClientHandler::directReconnect = false;
+std::atomic<TaskHandle_t> ClientHandler::loopTask{nullptr};
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+bool ClientHandler::syncPending = false;
+#endif
 
 ClientHandler::~ClientHandler() { inst = nullptr; }
 
@@ -60,26 +141,66 @@ ClientHandler *ClientHandler::instance() {
 }
 
 void ClientHandler::initialize(const std::string &SERVICE_UUID, const std::string
-&IMU_CHARACTERISTIC_UUID, const std::string &DEVICE_NAME, const uint8_t &SCAN_TIME,
-                               const uint32_t &SCAN_WINDOW, const uint32_t &SCAN_INTERVAL) {
+&IMU_CHARACTERISTIC_UUID, const std::string &CONTROL_CHARACTERISTIC_UUID,
+                               const ImuFormat &IMU_FORMAT, const uint8_t &IMU_FIELDS,
+                               const uint8_t &IMU_BATCH_SIZE, const uint8_t &IMU_BATCH_DELAY,
+                               const ImuTransport &IMU_TRANSPORT, const ImuLink &IMU_LINK,
+                               const uint32_t &LATENCY_BUDGET,
+                               const std::string &DEVICE_NAME, const uint8_t &SCAN_TIME,
+                               const uint32_t &SCAN_WINDOW, const uint32_t &SCAN_INTERVAL,
+                               const uint32_t &RECONNECT_TIMEOUT) {
     Log.traceln("ClientHandler::initialize - Begin");
 //todo fix static initialize
     // Set UUIDs
     serviceUUID = SERVICE_UUID;
+    serviceID = NimBLEUUID(SERVICE_UUID);
     IMUCharacteristicUUID = IMU_CHARACTERISTIC_UUID;
+    controlCharacteristicUUID = CONTROL_CHARACTERISTIC_UUID;
+    preferredFormat = IMU_FORMAT;
+    preferredFields = IMU_FIELDS | fieldBit(ImuField::QUATERNION);
+    batchSize = max(IMU_BATCH_SIZE, static_cast<uint8_t>(1));
+    batchDelay = IMU_BATCH_DELAY;
+    preferredTransport = IMU_TRANSPORT;
+    link = IMU_LINK;
+#if !CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+    if (link == ImuLink::BROADCAST) {
+        Log.warningln("ClientHandler::initialize - Periodic advertising is not enabled. "
+                      "Connecting instead");
+        link = ImuLink::CONNECTED;
+    }
+#endif
+    ConnectionPolicy::initialize(LATENCY_BUDGET);
     // Check and set scan time
     scanTime = SCAN_TIME;
+    reconnectTimeout = RECONNECT_TIMEOUT;
 
     // Initialize the BLE Device
     NimBLEDevice::init(DEVICE_NAME);
 
+    // Listen for the server's L2CAP channel. Without it the server keeps notifying
+    if (preferredTransport == ImuTransport::L2CAP) {
+        const int rc = ble_l2cap_create_server(L2CAP_PSM, L2CAP_SDU_SIZE, l2capEvent, nullptr);
+        if (rc != 0) {
+            Log.warningln("ClientHandler::initialize - Failed to listen for L2CAP (code %d)", rc);
+            preferredTransport = ImuTransport::NOTIFY;
+        }
+    }
+
+    // The callbacks post to the loop through the event queue
+    events = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(LinkEvent));
+    if (events == nullptr) {
+        Log.errorln("ClientHandler::initialize - Failed to create the event queue");
+        return;
+    }
+
     // Configure and start scan
     NimBLEScan *scanner = NimBLEDevice::getScan();
     scanner->setScanCallbacks(&scanCallback);
     scanner->setInterval(SCAN_INTERVAL);
     scanner->setWindow(SCAN_WINDOW);
     scanner->setActiveScan(true);
-    scanner->start(SCAN_TIME);
+    phaseStart = millis();
+    startScan();
     Log.traceln("ClientHandler::initialize - End");
 }
 
@@ -87,42 +208,418 @@ void
 ClientHandler::notifyCallback(NimBLERemoteCharacteristic *remoteCharacteristic, uint8_t *pData,
                               size_t length,
                               bool isNotify) {
-    //todo add a buffer?
-    if (remoteCharacteristic->getUUID() == BLEUUID(IMUCharacteristicUUID) && isNotify) {
-        if (length == 16) {
-            memcpy(&quaternion[0], &pData[0], sizeof(float));
-            memcpy(&quaternion[1], &pData[4], sizeof(float));
-            memcpy(&quaternion[2], &pData[8], sizeof(float));
-            memcpy(&quaternion[3], &pData[12], sizeof(float));
+    if (isNotify) {
+        const uint16_t handle = remoteCharacteristic->getHandle();
+        for (size_t i(0); i < notifyRouteCount; ++i) {
+            if (notifyRoutes[i].handle == handle) {
+                notifyRoutes[i].handler(pData, length);
+                return;
+            }
+        }
+    }
 
-            Log.verboseln("\tQuat:\t%D\t%D\t%D\t%D", quaternion[0], quaternion[1], quaternion[2],
-                          quaternion[3]);
+    Log.warningln("ClientHandler::notifyCallback - Unexpected characteristic or trigger");
+}
 
-        } else {
-            Log.warningln("ClientHandler::notifyCallback - Unexpected data length received");
+bool ClientHandler::subscribe(NimBLERemoteCharacteristic *characteristic, NotifyHandler handler) {
+    if (notifyRouteCount >= MAX_NOTIFY_ROUTES) {
+        Log.errorln("ClientHandler::subscribe - No notification routes left");
+        return false;
+    }
+
+    // Route before subscribing so the first notification is not missed
+    notifyRoutes[notifyRouteCount++] = {characteristic->getHandle(), handler};
+    if (!characteristic->subscribe(true, notifyCallback)) {
+        --notifyRouteCount;
+        return false;
+    }
+
+    return true;
+}
+
+void ClientHandler::handleIMUNotification(const uint8_t *data, size_t length) {
+    if (!ImuCodec::isValid(data, length)) {
+        Log.warningln("ClientHandler::handleIMUNotification - Malformed packet received");
+        return;
+    }
+
+    const uint32_t receiveTime = micros();
+    countNotification();
+
+    // A batch decodes as its newest packet, which arrived at receiveTime
+    ImuSample newest;
+    ImuCodec::decode(data, length, newest, fieldBit(ImuField::TIMESTAMP));
+
+    if (length != LEGACY_PACKET_SIZE && data[0] == static_cast<uint8_t>(ImuFormat::BATCH)) {
+        size_t offset = BATCH_HEADER_SIZE;
+        for (uint8_t i(0); i < data[1]; ++i) {
+            const size_t packetSize = ImuCodec::packetLength(data + offset, length - offset);
+            storePacket(data + offset, packetSize, receiveTime, newest.timestamp);
+            offset += packetSize;
         }
     } else {
-        Log.warningln("ClientHandler::notifyCallback - Unexpected characteristic or trigger");
+        storePacket(data, length, receiveTime, newest.timestamp);
     }
+
+    publishedStats.write(stats);
+    Log.verboseln("\tIMU notification: %d bytes", static_cast<int>(length));
 }
 
-const std::array<float, 4> &ClientHandler::getQuaternion() {
-    return quaternion;
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+void ClientHandler::syncToBroadcast(const NimBLEAdvertisedDevice *server) {
+    if (syncPending) {
+        return;
+    }
+
+    ble_gap_periodic_sync_params params{};
+    params.sync_timeout = SYNC_TIMEOUT;
+    const int rc = ble_gap_periodic_adv_sync_create(server->getAddress().getBase(),
+                                                    server->getSetId(), &params, syncEvent,
+                                                    nullptr);
+    if (rc != 0) {
+        Log.warningln("ClientHandler::syncToBroadcast - Failed to sync (code %d)", rc);
+        return;
+    }
+
+    syncPending = true;
+    Log.infoln("Syncing to the IMU broadcast of %s (%u us interval)",
+               server->getAddress().toString().c_str(),
+               static_cast<uint32_t>(server->getPeriodicInterval()) * 1250);
+}
+
+int ClientHandler::syncEvent(ble_gap_event *event, void *arg) {
+    LinkEvent linkEvent;
+    switch (event->type) {
+        case BLE_GAP_EVENT_PERIODIC_SYNC:
+            if (event->periodic_sync.status != 0) {
+                Log.warningln("ClientHandler::syncEvent - Sync failed (code %d)",
+                              event->periodic_sync.status);
+                syncPending = false;
+                linkEvent.type = LinkEventType::SYNC_FAILED;
+                linkEvent.reason = event->periodic_sync.status;
+                post(linkEvent);
+                break;
+            }
+
+            // A new sync may be to another server, with its own sequence numbers and clock
+            resetStats();
+            Log.infoln("Synced to the IMU broadcast");
+
+            // The scan only ran to find the train. Posted first so its end is not a failure
+            linkEvent.type = LinkEventType::SYNCED;
+            post(linkEvent);
+            NimBLEDevice::getScan()->stop();
+            break;
+        case BLE_GAP_EVENT_PERIODIC_REPORT:
+            // Broadcasts fit in one report, so partial ones are from a failed reception
+            if (event->periodic_report.data_status == BLE_HCI_PERIODIC_DATA_STATUS_COMPLETE) {
+                handleBroadcast(event->periodic_report.data, event->periodic_report.data_length);
+            }
+            break;
+        case BLE_GAP_EVENT_PERIODIC_SYNC_LOST:
+            Log.warningln("Lost the IMU broadcast (code %d). Starting scan",
+                          event->periodic_sync_lost.reason);
+            syncPending = false;
+            linkEvent.type = LinkEventType::SYNC_LOST;
+            linkEvent.reason = event->periodic_sync_lost.reason;
+            post(linkEvent);
+            break;
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+void ClientHandler::handleBroadcast(const uint8_t *data, size_t length) {
+    // Find the IMU batch among the AD structures
+    const uint8_t *batch = nullptr;
+    size_t batchLength = 0;
+    for (size_t offset(0); offset + BROADCAST_HEADER_SIZE <= length;
+         offset += data[offset] + 1) {
+        const size_t fieldLength = data[offset] + 1;
+        if (fieldLength > length - offset) {
+            break;
+        }
+
+        if (fieldLength > BROADCAST_HEADER_SIZE && data[offset + 1] == BLE_HS_ADV_TYPE_MFG_DATA &&
+            (data[offset + 2] | data[offset + 3] << 8) == BROADCAST_COMPANY_ID) {
+            batch = &data[offset + BROADCAST_HEADER_SIZE];
+            batchLength = fieldLength - BROADCAST_HEADER_SIZE;
+            break;
+        }
+    }
+
+    if (!batch || batchLength == LEGACY_PACKET_SIZE ||
+        batch[0] != static_cast<uint8_t>(ImuFormat::BATCH) ||
+        !ImuCodec::isValid(batch, batchLength)) {
+        Log.warningln("ClientHandler::handleBroadcast - Malformed broadcast received");
+        return;
+    }
+
+    const uint32_t receiveTime = micros();
+    countNotification();
+
+    ImuSample newest;
+    ImuCodec::decode(batch, batchLength, newest, fieldBit(ImuField::TIMESTAMP));
+
+    size_t offset = BATCH_HEADER_SIZE;
+    for (uint8_t i(0); i < batch[1]; ++i) {
+        const size_t packetSize = ImuCodec::packetLength(batch + offset, batchLength - offset);
+
+        // Earlier train events already carried the older samples
+        ImuSample header;
+        ImuCodec::decode(batch + offset, packetSize, header, fieldBit(ImuField::SEQUENCE));
+        if (!hasSequence || static_cast<int16_t>(header.sequence - lastSequence) > 0) {
+            storePacket(batch + offset, packetSize, receiveTime, newest.timestamp);
+        }
+        offset += packetSize;
+    }
+
+    publishedStats.write(stats);
+    Log.verboseln("\tIMU broadcast: %d bytes", static_cast<int>(batchLength));
+}
+#endif
+
+int ClientHandler::l2capEvent(ble_l2cap_event *event, void *arg) {
+    switch (event->type) {
+        case BLE_L2CAP_EVENT_COC_ACCEPT: {
+            // Give the channel somewhere to put the first SDU, or refuse it so the server keeps
+            // notifying
+            const int rc = readyNextSdu(event->accept.chan, L2CAP_SDU_SIZE);
+            if (rc != 0) {
+                Log.warningln("ClientHandler::l2capEvent - No receive buffer (code %d). Refusing "
+                              "the channel", rc);
+            }
+            return rc;
+        }
+        case BLE_L2CAP_EVENT_COC_CONNECTED:
+            if (event->connect.status == 0) {
+                Log.infoln("IMU stream moved to L2CAP");
+            } else {
+                Log.warningln("ClientHandler::l2capEvent - Channel failed (code %d)",
+                              event->connect.status);
+            }
+            break;
+        case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+            Log.infoln("IMU stream moved back to notifications");
+            break;
+        case BLE_L2CAP_EVENT_COC_DATA_RECEIVED: {
+            os_mbuf *sdu = event->receive.sdu_rx;
+            const uint16_t length = OS_MBUF_PKTLEN(sdu);
+            uint8_t frame[L2CAP_SDU_SIZE];
+            if (length <= sizeof(frame) && os_mbuf_copydata(sdu, 0, length, frame) == 0) {
+                handleIMUNotification(frame, length);
+            } else {
+                Log.warningln("ClientHandler::l2capEvent - Oversized frame received");
+            }
+
+            os_mbuf_free_chain(sdu);
+
+            // A channel that cannot receive is closed, so the server falls back to notifications
+            const int rc = readyNextSdu(event->receive.chan, L2CAP_SDU_SIZE);
+            if (rc != 0) {
+                Log.warningln("ClientHandler::l2capEvent - No receive buffer (code %d). Closing "
+                              "the channel", rc);
+                ble_l2cap_disconnect(event->receive.chan);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+void ClientHandler::storePacket(const uint8_t *data, size_t length, uint32_t receiveTime,
+                                uint32_t newestTimestamp) {
+    if (awaitingSample) {
+        awaitingSample = false;
+        Log.noticeln("IMU samples resumed %u ms after the link dropped (%s)",
+                     (receiveTime - linkLostTime) / 1000,
+                     directReconnect ? "direct reconnect" : "scan");
+    }
+
+    ImuSample header;
+    ImuCodec::decode(data, length, header,
+                     fieldBit(ImuField::SEQUENCE) | fieldBit(ImuField::TIMESTAMP));
+
+    ClientSample received{};
+    received.time = header.fields & fieldBit(ImuField::TIMESTAMP) ?
+                    receiveTime - (newestTimestamp - header.timestamp) : receiveTime;
+
+    // Aged from the back-dated time, so waiting for the batch does not count against the link
+    updateStats(header, received.time);
+    received.length = static_cast<uint8_t>(length);
+    memcpy(received.packet, data, length);
+
+    // A full ring refuses the sample; the latest packet is still updated
+    ClientSample *slot = sampleRing.claim();
+    if (slot) {
+        *slot = received;
+        sampleRing.publish();
+    } else {
+        ++stats.ringDropped;
+    }
+
+    latest.write(received);
+}
+
+ImuSnapshot ClientHandler::getSnapshot(uint8_t fields) {
+    ImuSnapshot snapshot;
+    ClientSample packet;
+    snapshot.sequence = latest.read(packet);
+    if (snapshot.sequence > 0) {
+        ImuCodec::decode(packet.packet, packet.length, snapshot.sample, fields);
+        snapshot.time = packet.time;
+    }
+
+    return snapshot;
+}
+
+std::array<float, 4> ClientHandler::getQuaternion() { return getSnapshot().sample.quaternion; }
+
+ImuSample ClientHandler::getSample(uint8_t fields) { return getSnapshot(fields).sample; }
+
+bool ClientHandler::nextSample(uint8_t fields, ImuSample &sample, uint32_t &time) {
+    const ClientSample *oldest = sampleRing.peek();
+    if (!oldest) {
+        return false;
+    }
+
+    ImuCodec::decode(oldest->packet, oldest->length, sample, fields);
+    time = oldest->time;
+    sampleRing.release();
+    return true;
+}
+
+void ClientHandler::updateStats(const ImuSample &header, uint32_t receiveTime) {
+    ++stats.received;
+
+    if (header.fields & fieldBit(ImuField::SEQUENCE)) {
+        const auto delta = static_cast<int16_t>(header.sequence - lastSequence);
+        if (!hasSequence || delta > 0) {
+            stats.lost += hasSequence ? delta - 1 : 0;
+            lastSequence = header.sequence;
+            hasSequence = true;
+        } else if (delta == 0) {
+            ++stats.duplicates;
+        } else {
+            // A late packet was already counted as lost
+            ++stats.reordered;
+            stats.lost -= stats.lost > 0 ? 1 : 0;
+        }
+    }
+
+    if (header.fields & fieldBit(ImuField::TIMESTAMP)) {
+        const auto offset = static_cast<int32_t>(receiveTime - header.timestamp);
+        ageFloor += AGE_FLOOR_LEAK;
+        if (!hasAgeFloor || offset - ageFloor < 0) {
+            ageFloor = offset;
+            hasAgeFloor = true;
+        }
+
+        stats.lastAge = static_cast<uint32_t>(offset - ageFloor);
+        stats.maxAge = max(stats.maxAge, stats.lastAge);
+        stats.totalAge += stats.lastAge;
+        ++stats.aged;
+    }
+}
+
+ImuStreamStats ClientHandler::getStats() {
+    ImuStreamStats copy;
+    if (!statsResetRequested.load()) {
+        publishedStats.read(copy);
+    }
+
+    return copy;
+}
+
+void ClientHandler::resetStats() { statsResetRequested.store(true); }
+
+void ClientHandler::countNotification() {
+    if (statsResetRequested.exchange(false)) {
+        stats = ImuStreamStats();
+        hasSequence = false;
+        hasAgeFloor = false;
+    }
+
+    ++stats.notifications;
+}
+
+bool ClientHandler::setProfile(ImuProfile profile) {
+    if (!remoteControlCharacteristic || !remoteControlCharacteristic->canWrite()) {
+        Log.warningln("ClientHandler::setProfile - No control characteristic");
+        return false;
+    }
+
+    const uint8_t command[] = {static_cast<uint8_t>(ImuCommand::SET_PROFILE),
+                               static_cast<uint8_t>(profile)};
+    if (!remoteControlCharacteristic->writeValue(command, sizeof(command), true)) {
+        Log.warningln("ClientHandler::setProfile - Failed to set the profile");
+        return false;
+    }
+
+    // The stream rate changes with the profile
+    ConnectionPolicy::restart();
+    Log.infoln("Requested IMU profile %d", static_cast<uint8_t>(profile));
+    return true;
 }
 
 void ClientHandler::loop() {
+    // A second task would race this one for events and the link state
+    TaskHandle_t running = nullptr;
+    if (!loopTask.compare_exchange_strong(running, xTaskGetCurrentTaskHandle())) {
+        Log.errorln("ClientHandler::loop - Already running in another task. Deleting this one");
+        vTaskDelete(nullptr);
+    }
+
+    uint32_t lastStatsLog = millis();
+    uint32_t lastReceived = 0;
+    LinkEvent event;
+
     while (true) {
         try {
+            // Events wake the loop at once. The timeout only paces the statistics and backoff
+            TickType_t wait = pdMS_TO_TICKS(HOUSEKEEPING_INTERVAL);
+            if (state == LinkState::BACKOFF) {
+                const auto remaining = static_cast<int32_t>(backoffEnd - millis());
+                wait = remaining > 0 ? min(wait, pdMS_TO_TICKS(remaining)) : 0;
+            }
+
+            if (xQueueReceive(events, &event, wait) == pdTRUE) {
+                handleEvent(event);
+            }
 
-            if (doConnect) {
-                if (connectToServer()) {
-                    Log.traceln("Successfully connected to the server");
-                    doConnect = false;
-                } else {
-                    Log.traceln("Failed to connect to the server");
-                }
+            if (state == LinkState::BACKOFF && static_cast<int32_t>(millis() - backoffEnd) >= 0) {
+                startScan();
             }
-            delay(10);
+
+            const ImuStreamStats current = getStats();
+            const uint32_t statsElapsed = millis() - lastStatsLog;
+            if (statsElapsed >= STATS_LOG_INTERVAL && current.received > 0) {
+                lastStatsLog = millis();
+
+                // The statistics reset on every connection or sync
+                const uint32_t delivered = current.received - (current.received >= lastReceived ?
+                                                                lastReceived : 0);
+                lastReceived = current.received;
+                Log.noticeln("IMU stream (%s): %u Hz delivered, %u received, %u lost (%F%%), %u "
+                             "duplicate, %u reordered, %u us mean age, %u us max age, %u dropped "
+                             "by the sample ring, %u bytes of loop stack free",
+                             link == ImuLink::BROADCAST ? "broadcast" : "connected",
+                             delivered * 1000 / statsElapsed, current.received, current.lost,
+                             current.lost * 100.0f /
+                             static_cast<float>(current.received + current.lost),
+                             current.duplicates, current.reordered,
+                             current.aged ? static_cast<uint32_t>(current.totalAge / current.aged) :
+                             0,
+                             current.maxAge, current.ringDropped,
+                             static_cast<uint32_t>(uxTaskGetStackHighWaterMark(nullptr)));
+            }
+
+            ConnectionPolicy::evaluate(current);
         } catch (const std::exception &ex) {
             Log.errorln("ClientHandler::Loop execution failed - %s", ex.what());
         } catch (...) {
@@ -131,23 +628,157 @@ void ClientHandler::loop() {
     }
 }
 
-bool ClientHandler::connectToServer() {
+void ClientHandler::post(const LinkEvent &event) {
+    const bool linkLoss = event.type == LinkEventType::DISCONNECTED ||
+                          event.type == LinkEventType::SYNC_LOST;
+
+    // Only the host task posts, so the free slots cannot change between the check and the send
+    if (events == nullptr ||
+        (!linkLoss && uxQueueSpacesAvailable(events) <= LINK_LOSS_RESERVE) ||
+        xQueueSend(events, &event, 0) != pdTRUE) {
+        Log.warningln("ClientHandler::post - Event queue full. Event %d dropped",
+                      static_cast<uint8_t>(event.type));
+    }
+}
+
+LinkState ClientHandler::getState() { return state; }
+
+void ClientHandler::handleEvent(const LinkEvent &event) {
+    switch (event.type) {
+        case LinkEventType::SERVER_FOUND:
+            // Reports queued before the scan stopped are stale
+            if (state == LinkState::SCANNING) {
+                serverAddress = NimBLEAddress(event.address);
+                linkToServer(false);
+            }
+            break;
+        case LinkEventType::SCAN_ENDED:
+            // Scans are also stopped on purpose, which leaves the scanning state first. The end of
+            // an earlier scan may be handled after a new one started
+            if (state == LinkState::SCANNING && !NimBLEDevice::getScan()->isScanning()) {
+                enterBackoff();
+            }
+            break;
+        case LinkEventType::DISCONNECTED:
+            // A drop while linking already failed that attempt
+            if (state != LinkState::SUBSCRIBED) {
+                break;
+            }
+
+            linkLostTime = micros();
+            awaitingSample = true;
+            if (serverAddress.isNull()) {
+                startScan();
+            } else {
+                Log.infoln("Reconnecting to %s", serverAddress.toString().c_str());
+                linkToServer(true);
+            }
+            break;
+        case LinkEventType::SYNCED:
+            directReconnect = false;
+            setState(LinkState::SUBSCRIBED);
+            break;
+        case LinkEventType::SYNC_FAILED:
+            // Restarting clears the scan's duplicate filter, so the train is found again
+            if (state == LinkState::SCANNING) {
+                NimBLEDevice::getScan()->stop();
+                startScan();
+            }
+            break;
+        case LinkEventType::SYNC_LOST:
+            linkLostTime = micros();
+            awaitingSample = true;
+            startScan();
+            break;
+    }
+}
+
+void ClientHandler::setState(LinkState next) {
+    const uint32_t now = millis();
+    phaseTimes[static_cast<uint8_t>(state)] += now - phaseStart;
+    phaseStart = now;
+
+    // The phases of one linking attempt are reported together once it succeeds
+    if (next == LinkState::SUBSCRIBED) {
+        Log.noticeln("Linked in %u ms: %u ms scanning, %u ms connecting, %u ms discovering, %u ms "
+                     "backing off (%s)",
+                     phaseTimes[static_cast<uint8_t>(LinkState::SCANNING)] +
+                     phaseTimes[static_cast<uint8_t>(LinkState::CONNECTING)] +
+                     phaseTimes[static_cast<uint8_t>(LinkState::DISCOVERING)] +
+                     phaseTimes[static_cast<uint8_t>(LinkState::BACKOFF)],
+                     phaseTimes[static_cast<uint8_t>(LinkState::SCANNING)],
+                     phaseTimes[static_cast<uint8_t>(LinkState::CONNECTING)],
+                     phaseTimes[static_cast<uint8_t>(LinkState::DISCOVERING)],
+                     phaseTimes[static_cast<uint8_t>(LinkState::BACKOFF)],
+                     directReconnect ? "direct reconnect" : "scan");
+        phaseTimes.fill(0);
+        backoff = MIN_BACKOFF;
+    }
+
+    Log.traceln("Link state %s -> %s", LINK_STATE_NAMES[static_cast<uint8_t>(state)],
+                LINK_STATE_NAMES[static_cast<uint8_t>(next)]);
+    state = next;
+}
+
+void ClientHandler::startScan() {
+    setState(LinkState::SCANNING);
+    serverFound = false;
+    if (!NimBLEDevice::getScan()->start(scanTime)) {
+        Log.warningln("ClientHandler::startScan - Failed to start the scan");
+        enterBackoff();
+    }
+}
+
+void ClientHandler::enterBackoff() {
+    setState(LinkState::BACKOFF);
+    backoffEnd = millis() + backoff;
+    Log.traceln("ClientHandler::enterBackoff - Scanning again in %u ms", backoff);
+    backoff = min(backoff * 2, MAX_BACKOFF);
+}
+
+void ClientHandler::linkToServer(bool direct) {
+    setState(LinkState::CONNECTING);
+    NimBLEClient *client = connectToServer(direct ? reconnectTimeout : CONNECT_TIMEOUT);
+    if (client) {
+        setState(LinkState::DISCOVERING);
+        if (discoverServer(client)) {
+            directReconnect = direct;
+            setState(LinkState::SUBSCRIBED);
+            return;
+        }
+
+        // Leave nothing connected that the next attempt would collide with
+        if (client->isConnected()) {
+            client->disconnect();
+        }
+    }
+
+    if (direct) {
+        // The server may have moved or gone, so look for one
+        Log.warningln("The last server did not answer. Starting scan");
+        startScan();
+    } else {
+        enterBackoff();
+    }
+}
+
+NimBLEClient *ClientHandler::connectToServer(uint32_t timeout) {
     Log.traceln("ClientHandler::connectToServer - Begin");
 
     // Ptrs for the method
     NimBLEClient *client = nullptr;
-    NimBLERemoteService *remoteService;
-    NimBLERemoteCharacteristic *remoteIMUCharacteristic;
 
     // Check if there is a client to reuse
     Log.traceln("ClientHandler::connectToServer - Checking for client reuse");
     if (NimBLEDevice::getCreatedClientCount()) {
-        client = NimBLEDevice::getClientByPeerAddress(advDevice->getAddress());
+        client = NimBLEDevice::getClientByPeerAddress(serverAddress);
 
+        // A known server keeps its discovered attributes, so only subscribing is repeated
         if (client) {   // Already know the device
-            if (!client->connect(advDevice, false)) {
+            client->setConnectTimeout(timeout);
+            if (!client->connect(serverAddress, false)) {
                 Log.errorln("ClientHandler::connectToServer - Reconnect failed");
-                return false;
+                return nullptr;
             }
             Log.traceln("ClientHandler::connectToServer - Reconnect success");
         } else {    // Don't know the device
@@ -161,7 +792,7 @@ bool ClientHandler::connectToServer() {
         if (NimBLEDevice::getCreatedClientCount() >= NIMBLE_MAX_CONNECTIONS) {
             Log.errorln("ClientHandler::connectToServer - Max clients reached. No connections "
                         "available");
-            return false;
+            return nullptr;
         }
 
         // Create the client and set callbacks
@@ -170,23 +801,24 @@ bool ClientHandler::connectToServer() {
         Log.traceln("New Client created");
 
         // Set connection params
-        client->setConnectionParams(12, 12, 0, 51); //todo figure this out
-        client->setConnectTimeout(5 * 1000);
+        ConnectionPolicy::setConnectParams(client);
+        client->setConnectTimeout(timeout);
 
         // See if the created client connected
-        if (!client->connect(advDevice)) {
+        if (!client->connect(serverAddress)) {
             NimBLEDevice::deleteClient(client);
             Log.errorln("ClientHandler::connectToServer - Failed to connect. Deleted client");
-            return false;
+            return nullptr;
         }
     }
 
     // Ensure client is connected
     Log.traceln("ClientHandler::connectToServer - Ensuring client is connected");
     if (!client->isConnected()) {
-        if (!client->connect(advDevice)) {
+        client->setConnectTimeout(timeout);
+        if (!client->connect(serverAddress)) {
             Log.errorln("ClientHandler::connectToServer - Failed to connect");
-            return false;
+            return nullptr;
         }
     }
     Log.info("Connected to: ");
@@ -194,36 +826,111 @@ bool ClientHandler::connectToServer() {
     Log.trace("RSSI: ");
     Log.traceln("%d", client->getRssi());
 
+    Log.traceln("ClientHandler::connectToServer - End");
+    return client;
+}
+
+bool ClientHandler::discoverServer(NimBLEClient *client) {
+    Log.traceln("ClientHandler::discoverServer - Begin");
+
     // Check the characteristics for the correct properties
-    Log.traceln("ClientHandler::connectToServer - Checking the characteristics");
-    remoteService = client->getService(serviceUUID);
-    if (remoteService) {
-        remoteIMUCharacteristic = remoteService->getCharacteristic(IMUCharacteristicUUID);
-
-        if (remoteIMUCharacteristic) {
-            // Make sure read is supported
-            if (!remoteIMUCharacteristic->canRead()) {
-                Log.errorln("ClientHandler::connectToServer - IMU Characteristic does not support "
-                            "read");
-                client->disconnect();
-                return false;
-            }
+    NimBLERemoteService *remoteService = client->getService(serviceUUID);
+    if (!remoteService) {
+        Log.errorln("ClientHandler::discoverServer - Service not found");
+        return false;
+    }
 
-            // Make sure notify is supported and subscribe
-            if (remoteIMUCharacteristic->canNotify()) {
-                if (!remoteIMUCharacteristic->subscribe(true, notifyCallback)) {
-                    Log.errorln("ClientHandler::connectToServer - Failed to subscribe to IMU "
-                                "Characteristic");
-                    client->disconnect();
-                    return false;
-                }
+    notifyRouteCount = 0;   // Handles differ between servers
+    remoteControlCharacteristic = remoteService->getCharacteristic(controlCharacteristicUUID);
+    negotiateFormat(remoteControlCharacteristic);
+    NimBLERemoteCharacteristic *remoteIMUCharacteristic =
+            remoteService->getCharacteristic(IMUCharacteristicUUID);
+
+    if (remoteIMUCharacteristic) {
+        // Make sure read is supported
+        if (!remoteIMUCharacteristic->canRead()) {
+            Log.errorln("ClientHandler::discoverServer - IMU Characteristic does not support "
+                        "read");
+            return false;
+        }
+
+        // Make sure notify is supported and subscribe
+        if (remoteIMUCharacteristic->canNotify()) {
+            resetStats();
+            if (!subscribe(remoteIMUCharacteristic, handleIMUNotification)) {
+                Log.errorln("ClientHandler::discoverServer - Failed to subscribe to IMU "
+                            "Characteristic");
+                return false;
             }
         }
-    } else {
-        Log.errorln("ClientHandler::connectToServer - Service not found");
-        return false;
     }
 
-    Log.traceln("ClientHandler::connectToServer - End");
+    Log.traceln("ClientHandler::discoverServer - End");
     return true;
+}
+
+void ClientHandler::negotiateFormat(NimBLERemoteCharacteristic *remoteControlCharacteristic) {
+    Log.traceln("ClientHandler::negotiateFormat - Begin");
+
+    if (!remoteControlCharacteristic || !remoteControlCharacteristic->canRead() ||
+        !remoteControlCharacteristic->canWrite()) {
+        Log.warningln("ClientHandler::negotiateFormat - No control characteristic. Using the "
+                      "legacy format");
+        return;
+    }
+
+    // The control characteristic reads as [version][supported formats][supported fields]
+    // [supported transports]. Older servers send a prefix of this, so the length is what says
+    // which masks are there
+    const NimBLEAttValue capabilities = remoteControlCharacteristic->readValue();
+    if (capabilities.length() < 2 || capabilities.data()[0] != PROTOCOL_VERSION) {
+        Log.warningln("ClientHandler::negotiateFormat - Unknown protocol version. Using the "
+                      "legacy format");
+        return;
+    }
+
+    // Servers without the field mask cannot send EXTENDED packets
+    uint8_t serverFormats = capabilities.data()[1];
+    uint8_t fields = fieldBit(ImuField::QUATERNION);
+    if (capabilities.length() < 3) {
+        serverFormats &= ~formatBit(ImuFormat::EXTENDED);
+    } else {
+        fields |= preferredFields & capabilities.data()[2] & ImuCodec::supportedFields();
+    }
+
+    const ImuFormat format = ImuCodec::negotiate(serverFormats, preferredFormat);
+    const uint8_t command[] = {static_cast<uint8_t>(ImuCommand::SET_FORMAT),
+                               static_cast<uint8_t>(format), fields};
+    const size_t commandLength = format == ImuFormat::EXTENDED ? 3 : 2;
+    if (!remoteControlCharacteristic->writeValue(command, commandLength, true)) {
+        Log.warningln("ClientHandler::negotiateFormat - Failed to set the format");
+        return;
+    }
+
+    // Batching is optional; without it every sample is its own notification
+    if (batchSize > 1 && format != ImuFormat::LEGACY &&
+        (serverFormats & formatBit(ImuFormat::BATCH))) {
+        const uint8_t batchCommand[] = {static_cast<uint8_t>(ImuCommand::SET_BATCH), batchSize,
+                                        batchDelay};
+        if (remoteControlCharacteristic->writeValue(batchCommand, sizeof(batchCommand), true)) {
+            Log.infoln("Requested batches of up to %d samples", batchSize);
+        } else {
+            Log.warningln("ClientHandler::negotiateFormat - Failed to set batching");
+        }
+    }
+
+    // Servers without the transport mask only notify
+    if (preferredTransport == ImuTransport::L2CAP && capabilities.length() >= 4 &&
+        (capabilities.data()[3] & transportBit(ImuTransport::L2CAP))) {
+        const uint8_t transportCommand[] = {static_cast<uint8_t>(ImuCommand::SET_TRANSPORT),
+                                            static_cast<uint8_t>(ImuTransport::L2CAP)};
+        if (!remoteControlCharacteristic->writeValue(transportCommand, sizeof(transportCommand),
+                                                     true)) {
+            Log.warningln("ClientHandler::negotiateFormat - Failed to set the transport");
+        }
+    }
+
+    Log.infoln("Negotiated IMU format %d (%d byte packets)", static_cast<uint8_t>(format),
+               static_cast<int>(ImuCodec::packetSize(format, fields)));
+    Log.traceln("ClientHandler::negotiateFormat - End");
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include "mechanism/connectionPolicy.h"
+
+namespace {
+constexpr uint16_t MIN_INTERVAL = 6;        // 7.5 ms, the shortest interval BLE allows
+constexpr uint16_t MAX_INTERVAL = 40;       // 50 ms, the longest an IMU stream should wait
+constexpr uint16_t SUPERVISION_TIMEOUT = 60;    // 600 ms, in 10 ms units. Over twice
+                                                // MAX_INTERVAL, as BLE requires
+constexpr uint32_t INTERVAL_UNIT = 1250;    // us per connection interval unit
+constexpr uint16_t DATA_LENGTH = 251;       // Largest LE data packet payload in bytes
+constexpr uint32_t EVALUATE_INTERVAL = 1000;    // ms of stream measured per evaluation
+}
+
+// Set static variables
+NimBLEClient *ConnectionPolicy::client = nullptr;
+uint32_t ConnectionPolicy::latencyBudget = 5000;
+uint16_t ConnectionPolicy::requested = MIN_INTERVAL;
+uint16_t ConnectionPolicy::latencyCap = MAX_INTERVAL;
+uint16_t ConnectionPolicy::achieved = 0;
+bool ConnectionPolicy::restarting = true;
+uint32_t ConnectionPolicy::windowStart = 0;
+uint32_t ConnectionPolicy::windowNotifications = 0;
+uint32_t ConnectionPolicy::windowAged = 0;
+uint64_t ConnectionPolicy::windowTotalAge = 0;
+
+void ConnectionPolicy::initialize(uint32_t latencyBudget) {
+    ConnectionPolicy::latencyBudget = latencyBudget;
+}
+
+void ConnectionPolicy::setConnectParams(NimBLEClient *client) {
+    client->setConnectionParams(MIN_INTERVAL, MIN_INTERVAL, 0, SUPERVISION_TIMEOUT);
+}
+
+void ConnectionPolicy::onConnect(NimBLEClient *client) {
+    ConnectionPolicy::client = client;
+    requested = MIN_INTERVAL;
+    latencyCap = MAX_INTERVAL;
+    achieved = 0;
+    restarting = true;
+
+    // Both are optional, so a refusal only costs throughput
+    const int rc = ble_gap_set_prefered_le_phy(client->getConnHandle(), BLE_GAP_LE_PHY_2M_MASK,
+                                               BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) {
+        Log.traceln("ConnectionPolicy::onConnect - 2M PHY unavailable (code %d)", rc);
+    }
+
+    if (!client->setDataLen(DATA_LENGTH)) {
+        Log.traceln("ConnectionPolicy::onConnect - Data length extension unavailable");
+    }
+}
+
+void ConnectionPolicy::onDisconnect() { client = nullptr; }
+
+void ConnectionPolicy::restart() {
+    latencyCap = MAX_INTERVAL;
+    restarting = true;
+    if (client && client->isConnected()) {
+        request(MIN_INTERVAL);
+    }
+}
+
+void ConnectionPolicy::evaluate(const ImuStreamStats &stats) {
+    if (!client || !client->isConnected()) {
+        return;
+    }
+
+    const uint32_t now = millis();
+    const uint32_t elapsed = now - windowStart;
+    if (!restarting && elapsed < EVALUATE_INTERVAL) {
+        return;
+    }
+
+    // Statistics reset on subscribe, which also starts a new window
+    const bool valid = !restarting && stats.notifications >= windowNotifications &&
+                       stats.aged >= windowAged;
+    const uint32_t notifications = stats.notifications - windowNotifications;
+    const uint32_t aged = stats.aged - windowAged;
+    const uint64_t totalAge = stats.totalAge - windowTotalAge;
+    windowStart = now;
+    windowNotifications = stats.notifications;
+    windowAged = stats.aged;
+    windowTotalAge = stats.totalAge;
+    restarting = false;
+
+    if (!valid || notifications == 0) {
+        return;
+    }
+
+    // Samples older than the budget are waiting on connection events
+    const uint32_t meanAge = aged ? static_cast<uint32_t>(totalAge / aged) : 0;
+    if (aged && meanAge > latencyBudget) {
+        latencyCap = max(static_cast<uint16_t>(latencyCap / 2), MIN_INTERVAL);
+    } else if (meanAge < latencyBudget / 2) {
+        latencyCap = min(static_cast<uint16_t>(latencyCap * 2), MAX_INTERVAL);
+    }
+
+    // One notification per connection event
+    const uint32_t period = elapsed * 1000 / notifications;
+    const auto streamInterval = static_cast<uint16_t>(
+            constrain(period / INTERVAL_UNIT, MIN_INTERVAL, MAX_INTERVAL));
+    const uint16_t interval = min(streamInterval, latencyCap);
+    if (interval != requested) {
+        request(interval);
+    }
+
+    const NimBLEConnInfo info = client->getConnInfo();
+    if (info.getConnInterval() != achieved) {
+        achieved = info.getConnInterval();
+        Log.noticeln("Connection: %u us interval (%u us requested), latency %d, timeout %d ms, "
+                     "%u us between notifications, %u us mean age",
+                     achieved * INTERVAL_UNIT, requested * INTERVAL_UNIT, info.getConnLatency(),
+                     info.getConnTimeout() * 10, period, meanAge);
+    }
+}
+
+void ConnectionPolicy::request(uint16_t interval) {
+    if (!client->updateConnParams(interval, interval, 0, SUPERVISION_TIMEOUT)) {
+        Log.warningln("ConnectionPolicy::request - Failed to request a %u us interval",
+                      interval * INTERVAL_UNIT);
+        return;
+    }
+
+    requested = interval;
+    Log.traceln("ConnectionPolicy::request - Requested a %u us interval", interval * INTERVAL_UNIT);
+}
@@ -1,6 +1,6 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 01/30/25
+// Last Modified: 10/18/2026
 
 //================================================================================================//
 
@@ -65,6 +65,22 @@ constexpr uint32_t BAUD_RATE = 115200;  // The baud rate for serial communicatio
  * This section configures the BLE Client by setting the UUIDs and device name. The UUIDs need to
  * match those set in server/server.cpp in order for the client to connect properly. New UUIDs
  * can be generated at https://www.uuidgenerator.net/
+ *
+ * With the SEQUENCE and TIMESTAMP fields, the client keeps loss, duplicate, and age statistics on
+ * the IMU stream and logs them periodically (see ClientHandler::getStats). The connection interval
+ * follows the stream's rate, and is shortened while samples arrive later than LATENCY_BUDGET (see
+ * ConnectionPolicy)
+ *
+ * Set IMU_LINK to BROADCAST to follow the server's periodic advertising train instead of
+ * connecting. Nothing is negotiated, so samples are always EXTENDED with SEQUENCE and TIMESTAMP,
+ * and there is no link to re-establish after a drop. The logged statistics name the link, so the
+ * delivery rate, loss, and age of the two can be compared. Both sides need extended and periodic
+ * advertising enabled in the NimBLE config, which the original ESP32 lacks. Build the
+ * mechanismBroadcast and serverBroadcast environments, which enable them for the ESP32-S3
+ *
+ * After a dropped connection the client connects straight to the last server's address, and only
+ * scans if it does not answer within RECONNECT_TIMEOUT. The time from the drop to the first new
+ * sample is logged
  */
 
 // Configuration Variables
@@ -73,13 +89,34 @@ const std::string SERVICE_UUID =
 // connect to
 const std::string IMU_CHARACTERISTIC_UUID =
         "72b9a4be-85fe-4cd5-ae42-f32414542c5a"; // The UUID for the IMU characteristic
+const std::string CONTROL_CHARACTERISTIC_UUID =
+        "031ead39-d232-4026-9df8-bbf1d58151b1"; // The UUID for the control characteristic
+constexpr ImuFormat IMU_FORMAT = ImuFormat::EXTENDED;   // The preferred IMU packet
+                                                      // format (see imuProtocol.h)
+constexpr uint8_t IMU_FIELDS = fieldBit(ImuField::QUATERNION) | fieldBit(ImuField::GYRO) |
+                               fieldBit(ImuField::SEQUENCE) | fieldBit(ImuField::TIMESTAMP); // The
+                                // fields to ask for if IMU_FORMAT is EXTENDED (see imuProtocol.h)
+constexpr uint8_t IMU_BATCH_SIZE = 4;   // The most IMU samples per notification (1 is no batching)
+constexpr uint8_t IMU_BATCH_DELAY = 10; // The most ms an IMU sample may wait for its batch
+constexpr ImuTransport IMU_TRANSPORT = ImuTransport::NOTIFY;    // How IMU packets arrive. L2CAP
+                                    // needs CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0 on both sides
+constexpr ImuLink IMU_LINK = ImuLink::CONNECTED;    // Connect, or follow the server's broadcast
+constexpr uint32_t LATENCY_BUDGET = 5000;   // The most mean IMU sample age in us before the
+                                            // connection interval is shortened. Ages leave out
+                                            // the IMU_BATCH_DELAY wait, so a budget below it is
+                                            // still reachable
 const std::string DEVICE_NAME = "Controller";   // The name of the device that the client is on
 constexpr uint8_t SCAN_TIME = 0;        // The duration of a scan in ms (0 is indefinite)
 constexpr uint32_t SCAN_WINDOW = 15;    // The scan window in ms
 constexpr uint32_t SCAN_INTERVAL = 45;  // The scan interval in ms
+constexpr uint32_t RECONNECT_TIMEOUT = 2000;    // The most ms to reconnect straight to the last
+                                                // server after a drop before scanning
 
 // Program Variables
 TaskHandle_t clientLoopHandle = nullptr;    // Ptr to the client's FreeRTOS task
+constexpr uint32_t CLIENT_STACK_SIZE = 4096;    // Bytes of stack for the client's task. Linking,
+                                                // negotiation and the statistics logs need more
+                                                // than 2048
 std::array <float, 4> quaternion; // Quaternion container : w, x, y, z
 
 /*
@@ -132,7 +169,6 @@ constexpr std::array<std::array<uint8_t, 2>, 3> motorPins = {FIRST_DRIVER_DIRECT
                                                              SECOND_DRIVER_PWM_PIN,
                                                              THIRD_DRIVER_DIRECTION_PIN,
                                                              THIRD_DRIVER_PWM_PIN};
-TaskHandle_t motorTaskHandle = nullptr;   // Ptr to the MotorHandler's FreeRTOS task
 
 //================================================================================================//
 
@@ -165,16 +201,6 @@ void encoderLoopTask(void *param) {
     EncoderHandler::instance()->loop();
 }
 
-/**
- * A freeRTOS task for the MotorHandler
- *
- * @param param - Any parameters to be used by the task (none)
- */
-void motorHandlerTask(void *param) {
-    Log.infoln("Starting MotorHandler task");
-    ClientHandler::instance()->loop();
-}
-
 void setup() {
     // Establish serial and logging
     Serial.begin(BAUD_RATE);
@@ -183,8 +209,12 @@ void setup() {
 
     // Initialize the BLE Client
     try {
-        ClientHandler::instance()->initialize(SERVICE_UUID, IMU_CHARACTERISTIC_UUID, DEVICE_NAME,
-                                              SCAN_TIME, SCAN_WINDOW, SCAN_INTERVAL);
+        ClientHandler::instance()->initialize(SERVICE_UUID, IMU_CHARACTERISTIC_UUID,
+                                              CONTROL_CHARACTERISTIC_UUID, IMU_FORMAT,
+                                              IMU_FIELDS, IMU_BATCH_SIZE, IMU_BATCH_DELAY,
+                                              IMU_TRANSPORT, IMU_LINK, LATENCY_BUDGET,
+                                              DEVICE_NAME, SCAN_TIME, SCAN_WINDOW,
+                                              SCAN_INTERVAL, RECONNECT_TIMEOUT);
     } catch (const std::exception &ex) {
         Log.errorln("Failed to initialize ClientHandler - %s", ex.what());
         restart();
@@ -195,7 +225,7 @@ void setup() {
 
     // Create background task for the client
     BaseType_t clientResult = xTaskCreate(clientLoopTask, "ClientHandler::Loop",
-                                          2048, nullptr, 1, &clientLoopHandle);
+                                          CLIENT_STACK_SIZE, nullptr, 1, &clientLoopHandle);
 
     if (clientResult != pdPASS) {
         Log.errorln("Failed to create clientLoopTask");
@@ -231,16 +261,6 @@ void setup() {
         Log.errorln("Failed to initialize MotorHandler - Unknown Error");
     }
 
-    // Create background task for the motors
-    BaseType_t motorResult = xTaskCreate(motorHandlerTask, "MotorHandler::Loop",
-                                          2048, nullptr, 3, &motorTaskHandle);
-
-    if (motorResult != pdPASS) {
-        Log.errorln("Failed to create MotorHandlerTask");
-        restart();
-    }
-
-
     // Prompt user for first command
     Serial.print("Enter a command or enter 'h' for help: ");
 }
@@ -261,10 +281,7 @@ void loop() {
         if (command == 'h') {
             MotorHandler::help();
         } else if (command == 'x') {
-            if (motorTaskHandle != nullptr) {
-                vTaskDelete(motorTaskHandle);
-                motorTaskHandle = nullptr;
-            }
+            MotorHandler::instance()->stop();
             restart();
         } else if(command == 'f') {
             MotorHandler::instance()->forward();
@@ -283,11 +300,16 @@ void loop() {
         Serial.print("Enter a command: ");
     }
 
-    // Send data over serial to ROS2
-    quaternion = ClientHandler::instance()->getQuaternion();
-    counts = EncoderHandler::instance()->getCounts();
+    // Send every IMU sample received over serial to ROS2, oldest first
+    ImuSample sample;
+    uint32_t sampleTime;
+    while (ClientHandler::instance()->nextSample(fieldBit(ImuField::QUATERNION), sample,
+                                                 sampleTime)) {
+        quaternion = sample.quaternion;
+        Serial.printf("Q:\t%f\t%f\t%f\t%f\n", quaternion[0], quaternion[1], quaternion[2],
+                       quaternion[3]);
+    }
 
-    Serial.printf("Q:\t%f\t%f\t%f\t%f\n", quaternion[0], quaternion[1], quaternion[2],
-                   quaternion[3]);
+    counts = EncoderHandler::instance()->getCounts();
     Serial.printf("E:\t%lld\t%lld\t%lld\n", counts[0], counts[1], counts[2]);
 }
\ No newline at end of file
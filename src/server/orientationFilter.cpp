@@ -0,0 +1,126 @@
+// Author: Robert Polk
+// Copyright (c) 2024 BLINK. All rights reserved.
+// Last Modified: 10/18/2026
+
+#include "server/orientationFilter.h"
+#include "control/fastMath.h"
+
+namespace {
+/**
+ * Approximate 1/sqrt(x) with a second Newton step. The quaternion is renormalized every sample,
+ * so the single step's bias would otherwise leave it about 0.2% short of unit length
+ *
+ * @param x - The value to take the reciprocal square root of (x > 0)
+ * @return 1/sqrt(x)
+ */
+inline float invSqrtRefined(float x) {
+    const float y = FastMath::invSqrt(x);
+    return y * (1.5f - 0.5f * x * y * y);
+}
+}
+
+OrientationFilter::OrientationFilter(Type type, float proportionalGain, float integralGain)
+        : type(type), proportionalGain(proportionalGain), integralGain(integralGain) {}
+
+void OrientationFilter::update(float gx, float gy, float gz, float ax, float ay, float az,
+                               float dt) {
+    if (type == Type::MADGWICK) {
+        updateMadgwick(gx, gy, gz, ax, ay, az, dt);
+    } else {
+        updateMahony(gx, gy, gz, ax, ay, az, dt);
+    }
+}
+
+void OrientationFilter::reset() {
+    q = {1.0f, 0.0f, 0.0f, 0.0f};
+    integralError = {};
+}
+
+void OrientationFilter::updateMadgwick(float gx, float gy, float gz, float ax, float ay, float az,
+                                       float dt) {
+    const float w = q[0], x = q[1], y = q[2], z = q[3];
+
+    // Rate of change of the quaternion from the gyro
+    float qDotW = 0.5f * (-x * gx - y * gy - z * gz);
+    float qDotX = 0.5f * (w * gx + y * gz - z * gy);
+    float qDotY = 0.5f * (w * gy - x * gz + z * gx);
+    float qDotZ = 0.5f * (w * gz + x * gy - y * gx);
+
+    const float accelSquared = ax * ax + ay * ay + az * az;
+    if (accelSquared > 0.0f) {
+        const float accelNorm = FastMath::invSqrt(accelSquared);
+        ax *= accelNorm;
+        ay *= accelNorm;
+        az *= accelNorm;
+
+        // Gradient of the gravity error (Madgwick eq. 25, with the terms shared)
+        const float w2 = 2.0f * w, x2 = 2.0f * x, y2 = 2.0f * y, z2 = 2.0f * z;
+        const float w4 = 4.0f * w, x4 = 4.0f * x, y4 = 4.0f * y;
+        const float x8 = 8.0f * x, y8 = 8.0f * y;
+        const float ww = w * w, xx = x * x, yy = y * y, zz = z * z;
+
+        float sW = w4 * yy + y2 * ax + w4 * xx - x2 * ay;
+        float sX = x4 * zz - z2 * ax + 4.0f * ww * x - w2 * ay - x4 + x8 * xx + x8 * yy + x4 * az;
+        float sY = 4.0f * ww * y + w2 * ax + y4 * zz - z2 * ay - y4 + y8 * xx + y8 * yy + y4 * az;
+        float sZ = 4.0f * xx * z - x2 * ax + 4.0f * yy * z - y2 * ay;
+
+        const float stepSquared = sW * sW + sX * sX + sY * sY + sZ * sZ;
+        if (stepSquared > 0.0f) {
+            const float stepNorm = proportionalGain * FastMath::invSqrt(stepSquared);
+            qDotW -= stepNorm * sW;
+            qDotX -= stepNorm * sX;
+            qDotY -= stepNorm * sY;
+            qDotZ -= stepNorm * sZ;
+        }
+    }
+
+    integrate(qDotW, qDotX, qDotY, qDotZ, dt);
+}
+
+void OrientationFilter::updateMahony(float gx, float gy, float gz, float ax, float ay, float az,
+                                     float dt) {
+    const float w = q[0], x = q[1], y = q[2], z = q[3];
+
+    const float accelSquared = ax * ax + ay * ay + az * az;
+    if (accelSquared > 0.0f) {
+        const float accelNorm = FastMath::invSqrt(accelSquared);
+        ax *= accelNorm;
+        ay *= accelNorm;
+        az *= accelNorm;
+
+        // Gravity predicted by the current orientation, in the body frame
+        const float vx = 2.0f * (x * z - w * y);
+        const float vy = 2.0f * (w * x + y * z);
+        const float vz = w * w - x * x - y * y + z * z;
+
+        // Error is the rotation from predicted to measured gravity
+        const float ex = ay * vz - az * vy;
+        const float ey = az * vx - ax * vz;
+        const float ez = ax * vy - ay * vx;
+
+        if (integralGain > 0.0f) {
+            integralError[0] += integralGain * ex * dt;
+            integralError[1] += integralGain * ey * dt;
+            integralError[2] += integralGain * ez * dt;
+        }
+
+        gx += proportionalGain * ex + integralError[0];
+        gy += proportionalGain * ey + integralError[1];
+        gz += proportionalGain * ez + integralError[2];
+    }
+
+    integrate(0.5f * (-x * gx - y * gy - z * gz), 0.5f * (w * gx + y * gz - z * gy),
+              0.5f * (w * gy - x * gz + z * gx), 0.5f * (w * gz + x * gy - y * gx), dt);
+}
+
+void OrientationFilter::integrate(float qDotW, float qDotX, float qDotY, float qDotZ, float dt) {
+    q[0] += qDotW * dt;
+    q[1] += qDotX * dt;
+    q[2] += qDotY * dt;
+    q[3] += qDotZ * dt;
+
+    const float norm = invSqrtRefined(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    for (float &component : q) {
+        component *= norm;
+    }
+}
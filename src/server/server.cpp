@@ -1,6 +1,6 @@
 // Author: Robert Polk
 // Copyright (c) 2024 BLINK. All rights reserved.
-// Last Modified: 01/30/25
+// Last Modified: 10/18/2026
 
 //================================================================================================//
 
@@ -21,8 +21,18 @@
 #include <Arduino.h>
 #include <ArduinoLog.h>
 #include <NimBLEDevice.h>
+#include <nimble/nimble/host/include/host/ble_hs.h>
+#include <nimble/porting/nimble/include/os/os_mbuf.h>
+#include <nimble/porting/nimble/include/nimble/nimble_port.h>
+#include <Preferences.h>
+#include <soc/soc.h>
 #include "..\lib\I2Cdev\I2Cdev.h"
 #include "..\lib\MPU6050\MPU6050_6Axis_MotionApps20.h"
+#include "..\lib\I2Cdev\I2CdevAsync.h"
+#include "common/imuProtocol.h"
+#include "common/l2capSdu.h"
+#include "server/dmpSampleRing.h"
+#include "server/orientationFilter.h"
 
 /*
  * Logging
@@ -59,6 +69,26 @@ constexpr uint32_t BAUD_RATE = 115200;  // The baud rate for serial communicatio
  * This section configures the BLE Server by setting the UUIDs and device name. The UUIDs need to
  * match those set in mechanism/main.cpp in order for the server to connect properly. New
  * UUIDs can be generated at https://www.uuidgenerator.net/.
+ *
+ * Samples are published from their own task on the NimBLE host's core, so notifications never
+ * wait behind sensor reads, and the main loop only handles advertising and reports
+ *
+ * Clients may ask for batching with SET_BATCH. Samples are then packed into one notification,
+ * up to the client's sample limit or what the negotiated MTU holds, and sent once the limit is
+ * reached or the oldest sample has waited the client's deadline
+ *
+ * Clients may also ask for the L2CAP transport with SET_TRANSPORT. The server then opens an L2CAP
+ * channel to the client and sends what would have been notifications over it, which lets batches
+ * fill a whole data packet whatever the ATT MTU. Frames that arrive while the channel is out of
+ * credits are dropped and counted. Enable it in the NimBLE config with
+ * CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM
+ *
+ * With CONFIG_BT_NIMBLE_EXT_ADV and CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV set in the NimBLE config
+ * (and CONFIG_BT_NIMBLE_MAX_EXT_ADV_INSTANCES at least 2), every sample is also broadcast in a
+ * periodic advertising train, connected or not, so clients can follow the IMU without connecting.
+ * Each train event repeats the newest BROADCAST_DEPTH samples. The original ESP32 has no extended
+ * advertising, so this needs an ESP32-C3 or ESP32-S3. The serverBroadcast environment in
+ * platformio.ini builds it for the ESP32-S3
  */
 
 // Configuration Variables
@@ -67,11 +97,56 @@ const std::string SERVICE_UUID =
                                                 // connect to
 const std::string IMU_CHARACTERISTIC_UUID =
         "72b9a4be-85fe-4cd5-ae42-f32414542c5a"; // The UUID for the IMU characteristic
+const std::string CONTROL_CHARACTERISTIC_UUID =
+        "031ead39-d232-4026-9df8-bbf1d58151b1"; // The UUID for the control characteristic
 const std::string DEVICE_NAME = "Eyeball";      // The name of the device that the server is on
+constexpr BaseType_t PUBLISH_CORE = PRO_CPU_NUM;    // Core for the publish task, which NimBLE's
+                                                    // host also runs on
+constexpr uint32_t PIPELINE_REPORT_INTERVAL = 5000; // ms between CPU and queue depth reports
+constexpr uint16_t BROADCAST_INTERVAL = 8;  // Periodic advertising interval in 1.25 ms units
+                                            // (10 ms, one BALANCED sample)
+constexpr uint8_t BROADCAST_DEPTH = 3;      // Samples repeated in each periodic advertisement
 
 // Program Variables
 NimBLEServer *server = nullptr; // Ptr to the server
 NimBLECharacteristic *IMUCharacteristic = nullptr;  // Ptr to the IMU characteristic
+NimBLECharacteristic *controlCharacteristic = nullptr;  // Ptr to the control characteristic
+TaskHandle_t publishTaskHandle = nullptr;   // Ptr to the sample publishing FreeRTOS task
+std::atomic<uint32_t> publishBusyTime{0};   // us the publish task worked since the last report
+std::atomic<uint32_t> maxQueueDepth{0};     // Most samples waiting since the last report
+// Set by the NimBLE host task and read by the publish task
+std::atomic<ImuFormat> imuFormat{ImuFormat::LEGACY};    // The format negotiated with the client
+std::atomic<uint8_t> imuFields{fieldBit(ImuField::QUATERNION)}; // The EXTENDED fields the client
+                                                                // chose
+std::atomic<uint8_t> batchLimit{1}; // Most samples per notification the client asked for (1 is
+                                    // off)
+std::atomic<uint8_t> batchDelay{0}; // Most ms the client will let a sample wait for its batch
+std::atomic<uint16_t> peerMTU{BLE_ATT_MTU_DFLT};    // The ATT MTU negotiated with the client
+uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE;  // The client's connection handle
+std::atomic<ble_l2cap_chan *> l2capChannel{nullptr};    // The L2CAP channel to the client (null
+                                                        // if closed). NimBLE frees channels on the
+                                                        // host task, so only it may send on one
+std::atomic<uint16_t> l2capMTU{0};  // The largest SDU the client accepts on l2capChannel
+os_mqueue l2capQueue;   // SDUs the publish task hands to the host task to send
+std::atomic<uint8_t> l2capQueued{0};    // SDUs waiting in l2capQueue
+constexpr uint8_t L2CAP_QUEUE_DEPTH = 4;    // Most SDUs that may wait for the host task
+bool l2capConnecting = false;   // If a channel is being opened or is open, owned by the host task
+std::atomic<uint32_t> l2capDropped{0};  // Frames dropped for lack of L2CAP credits, or because
+                                        // the channel closed, since the last report
+constexpr uint8_t SUPPORTED_TRANSPORTS = transportBit(ImuTransport::NOTIFY) |
+        (CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0 ? transportBit(ImuTransport::L2CAP) : 0);
+constexpr uint8_t CONNECTABLE_INSTANCE = 0;    // Extended advertising instance clients connect to
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+static_assert(CONFIG_BT_NIMBLE_MAX_EXT_ADV_INSTANCES > BROADCAST_SID,
+              "The broadcast needs its own advertising instance");
+bool broadcasting = false;  // If the periodic advertising train started
+uint8_t broadcastPackets[BROADCAST_DEPTH][MAX_PACKET_SIZE]; // The newest broadcast packets, owned
+                                                            // by the publish task
+uint8_t broadcastPacketLength = 0;  // Length of each packet in broadcastPackets
+uint8_t broadcastNext = 0;  // Index in broadcastPackets the next packet is written to
+uint8_t broadcastCount = 0; // Packets in broadcastPackets
+std::atomic<uint32_t> broadcastFailed{0};   // Train updates that failed since the last report
+#endif
 bool connected = false; // If the server is currently connected to a client
 bool prevConnected = false; // Previous state of connected
 
@@ -81,7 +156,34 @@ bool prevConnected = false; // Previous state of connected
  * This section configures the IMU by setting the interrupt pin, I2C clock, and variable offsets.
  * Offset values can be obtained from the IMU_Zero program found in the examples folder of the
  * library
+ *
+ * The offsets are only the starting point for the first calibration. Calibrated offsets and the
+ * IMU temperature are saved to flash, and later boots load them and just check the residual bias
+ * while still. Full calibration only runs again if the bias or temperature drifted past the
+ * limits below, or if FORCE_CALIBRATION is set. The IMU must be still and level at boot either way
+ *
+ * The IMU's interrupt wakes a task that burst reads every packet in the DMP's FIFO into a
+ * timestamped sample ring, which the publish task transmits from. The IMU task is pinned to the
+ * other core from the radio, so BLE stalls never delay sensor reads. Samples lost to a full ring
+ * or an overflowed FIFO are counted and logged
+ *
+ * Set the profile to trade noise for latency. Each pairs a DMP output rate with a low-pass
+ * filter bandwidth (see ImuProfile in common/imuProtocol.h). Clients can switch it while
+ * connected with the SET_PROFILE command
+ *
+ * Set the mode to RAW to bypass the DMP for more bandwidth. The IMU then samples its gyro and
+ * accelerometer at up to 1 kHz and a Madgwick or Mahony filter on the ESP32 integrates every
+ * sample. Every RAW_OUTPUT_DIVISOR-th result is put in the sample ring in the DMP's packet layout,
+ * so it is transmitted like a DMP packet. Profiles do not apply in RAW mode
+ */
+
+/**
+ * Where orientation comes from
  */
+enum class ImuMode : uint8_t {
+    DMP,    // The IMU's DMP fuses the samples (up to 200 Hz)
+    RAW     // OrientationFilter fuses raw samples on the ESP32 (up to 1 kHz)
+};
 
 // Configuration Variables
 const uint8_t INTERRUPT_PIN = 18;   // GPIO pin connected to the INT pin on the IMU
@@ -92,21 +194,90 @@ int16_t Z_ACCEL_OFFSET = 595;
 int16_t X_GYRO_OFFSET = -103;
 int16_t Y_GYRO_OFFSET = 9;
 int16_t Z_GYRO_OFFSET = 34;
+bool FORCE_CALIBRATION = false;     // Ignore saved offsets and run full calibration
+constexpr uint8_t RESIDUAL_SAMPLES = 40;    // Readings averaged for the warm-boot bias check
+constexpr float MAX_GYRO_RESIDUAL = 8.0f;   // Max mean gyro bias in LSB (0.5 deg/s)
+constexpr float MAX_ACCEL_RESIDUAL = 160.0f;    // Max mean accel bias in LSB (~0.01 g)
+constexpr float MAX_TEMPERATURE_DRIFT = 10.0f;  // Max change in deg C since the last calibration
+constexpr uint32_t IMU_WAIT_TIMEOUT = 100;  // Max ms to wait for an interrupt before checking
+                                            // the FIFO anyway
+constexpr ImuProfile IMU_PROFILE = ImuProfile::BALANCED;    // The rate and filter profile at boot
+constexpr uint32_t PROFILE_MEASURE_TIME = 1000; // ms of samples used to measure a new profile
+constexpr BaseType_t IMU_CORE = APP_CPU_NUM;    // Core for the IMU and I2C tasks
+constexpr uint32_t IMU_STACK_SIZE = 4096;   // Bytes of stack for the IMU task. Profile changes,
+                                            // the raw filter and %F logging need more than 2048
+constexpr ImuMode IMU_MODE = ImuMode::DMP;  // The orientation source
+constexpr uint8_t RAW_RATE_DIVISOR = 0;     // Raw sample rate = 1 kHz / (1 + RAW_RATE_DIVISOR)
+constexpr uint8_t RAW_DLPF_MODE = MPU6050_DLPF_BW_188;  // The low-pass filter for raw samples
+constexpr uint8_t RAW_OUTPUT_DIVISOR = 5;   // Transmit every nth filtered sample
+constexpr OrientationFilter::Type RAW_FILTER = OrientationFilter::Type::MAHONY; // The filter
+constexpr float RAW_FILTER_KP = 1.0f;       // Mahony's Kp (~1) or Madgwick's beta (~0.1)
+constexpr float RAW_FILTER_KI = 0.0f;       // Mahony's Ki, for gyro bias tracking
 
 // Program Variables
 MPU6050 mpu;            // MPU instance
-bool DMPInit = false;   // If the DMP initialization was successful
-volatile bool interrupt = false; // If the IMU interrupt pin has gone high
+bool IMUInit = false;   // If the IMU initialization was successful
+constexpr uint16_t FIFO_SIZE = 1024;        // Size of the MPU6050's FIFO in bytes
+constexpr float RAW_GYRO_SCALE = 3.14159265f / (180.0f * 16.4f);  // rad/s per LSB at 2000 deg/s
+constexpr float Q30_SCALE = 1073741824.0f;  // 1.0 in the DMP's Q30 fixed point
+constexpr uint8_t PACKETS_PER_READ = 8;    // Whole packets per I2C transaction. I2CdevAsync
+                                            // reads straight into IMUBursts, so Wire's buffer
+                                            // doesn't cap it. 8 packets take about 7.6 ms at
+                                            // 400 kHz, inside I2CdevAsync::timeout
+TaskHandle_t IMUTaskHandle = nullptr;   // Ptr to the FIFO draining FreeRTOS task
+volatile uint32_t dataReadyTime = 0;    // micros() of the IMU's last interrupt, when its newest
+                                        // sample was ready
+uint8_t IMUBursts[2][PACKETS_PER_READ * DMP_PACKET_SIZE];   // Double buffered FIFO reads, owned
+                                                            // by the IMU task
+std::atomic<uint32_t> IMUBusyTime{0};   // us the IMU task worked since the last report
+DmpSampleRing samples;      // DMP packets waiting to be transmitted
+uint32_t fifoOverflows = 0; // The number of times the FIFO overflowed and was reset
+SemaphoreHandle_t burstDone = nullptr;  // Given when an asynchronous FIFO read completes
+volatile esp_err_t burstResult = ESP_OK;    // The result of the last asynchronous FIFO read
+
+/**
+ * A DMP output rate and low-pass filter pairing
+ */
+struct DmpProfile {
+    const char *name;
+    uint8_t rateDivisor;    // DMP output rate = 200 Hz / (1 + rateDivisor)
+    uint8_t DLPFMode;       // MPU6050_DLPF_BW_*
+    float filterDelay;      // The DLPF's gyro delay in ms, from the MPU6050 datasheet
+};
+
+constexpr DmpProfile DMP_PROFILES[] = {{"low latency", 0, MPU6050_DLPF_BW_188, 1.9f},
+                                       {"balanced", 1, MPU6050_DLPF_BW_42, 4.8f},
+                                       {"low noise", 3, MPU6050_DLPF_BW_20, 8.3f}};
+static_assert(sizeof(DMP_PROFILES) / sizeof(DMP_PROFILES[0]) ==
+              static_cast<size_t>(ImuProfile::COUNT), "Every ImuProfile needs a DmpProfile");
+ImuProfile activeProfile = IMU_PROFILE; // The profile the DMP is running, owned by the IMU task
+volatile ImuProfile requestedProfile = IMU_PROFILE; // The profile the IMU task should switch to
 //uint8_t interruptStatus;    // Holds the interrupt status byte from the IMU
 uint8_t DMPStatus;          // The result of each DMP operation (!0 = error)
+Preferences calibrationStore;   // Flash storage for the calibrated offsets
 //uint16_t packetSize;        // Expected DMP packet size (default is 42 bytes)
 //uint16_t fifoCount;         // Sum of all bytes currently in the FIFO
-uint8_t fifoBuffer[64];     // FIFO storage buffer
-Quaternion quaternion;      // Quaternion container [w,x,y,z]
-uint8_t quaternionData[16]; // Buffer to hold the 4 quaternion floats [wxyz]
+uint8_t quaternionData[MAX_PACKET_SIZE];    // Buffer to hold the encoded quaternion packet
+size_t quaternionDataLength = 0;    // Length of the encoded packet in quaternionData
+uint8_t batch[MAX_NOTIFICATION_SIZE];   // The batch being filled, owned by the publish task
+size_t batchLength = BATCH_HEADER_SIZE; // Length of the batch so far, including its header
+uint8_t batchCount = 0;     // Samples in the batch so far
+uint32_t batchDeadline = 0; // micros() when the batch must be sent
+uint16_t nextSequence = 0;  // The sequence number of the next sample read, owned by the IMU task
 
 //================================================================================================//
 
+/**
+ * Start connectable advertising. Extended advertising builds advertise in CONNECTABLE_INSTANCE
+ */
+void startAdvertising() {
+#if CONFIG_BT_NIMBLE_EXT_ADV
+    NimBLEDevice::startAdvertising(CONNECTABLE_INSTANCE);
+#else
+    NimBLEDevice::startAdvertising();
+#endif
+}
+
 /**
  * A struct to define what to do for server events
  */
@@ -118,6 +289,8 @@ struct ServerCallbacks final : public NimBLEServerCallbacks {
      * @param connInfo - The connection info
      */
     void onConnect(NimBLEServer *connectedServer, NimBLEConnInfo &connInfo) override {
+        peerMTU = connInfo.getMTU();
+        connHandle = connInfo.getConnHandle();
         connected = true;
         Log.trace("Client Address: ");
         Log.traceln(connInfo.getAddress().toString().c_str());
@@ -134,9 +307,27 @@ struct ServerCallbacks final : public NimBLEServerCallbacks {
     void
     onDisconnect(NimBLEServer *disconnectedServer, NimBLEConnInfo &connInfo, int reason) override {
         connected = false;
+        imuFormat = ImuFormat::LEGACY;  // The next client may not negotiate
+        imuFields = fieldBit(ImuField::QUATERNION);
+        batchLimit = 1;
+        peerMTU = BLE_ATT_MTU_DFLT;
+        l2capChannel = nullptr; // Closed with the connection
+        l2capConnecting = false;
+        connHandle = BLE_HS_CONN_HANDLE_NONE;
         Log.warningln("Client disconnected");
         Log.infoln("Starting advertising");
-        NimBLEDevice::startAdvertising();
+        startAdvertising();
+    }
+
+    /**
+     * Called when the client exchanges MTUs. Sets the space batches can fill
+     *
+     * @param MTU - The new MTU
+     * @param connInfo - The connection info
+     */
+    void onMTUChange(uint16_t MTU, NimBLEConnInfo &connInfo) override {
+        peerMTU = MTU;
+        Log.infoln("MTU set to %d", MTU);
     }
 };
 
@@ -144,12 +335,198 @@ static ServerCallbacks serverCallback; // Callback instance
 
 //================================================================================================//
 
+/**
+ * Called for events on the L2CAP channel to the client
+ *
+ * @param event - The event
+ * @param arg - Unused
+ * @return 0, as NimBLE expects
+ */
+int l2capEvent(ble_l2cap_event *event, void *arg) {
+    switch (event->type) {
+        case BLE_L2CAP_EVENT_COC_CONNECTED: {
+            if (event->connect.status != 0) {
+                Log.warningln("L2CAP channel refused (code %d). Using notifications",
+                              event->connect.status);
+                break;
+            }
+
+            ble_l2cap_chan_info info;
+            ble_l2cap_get_chan_info(event->connect.chan, &info);
+            l2capMTU = info.peer_coc_mtu;
+            l2capChannel = event->connect.chan;
+            Log.infoln("L2CAP channel open (%d byte SDUs)", info.peer_coc_mtu);
+            break;
+        }
+        case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+            // Also reported for a channel that never opened, as NimBLE frees it
+            l2capChannel = nullptr;
+            l2capConnecting = false;
+            Log.infoln("L2CAP channel closed. Using notifications");
+            break;
+        case BLE_L2CAP_EVENT_COC_DATA_RECEIVED:
+            // The client only sends on GATT. Drop it and make room for the next SDU
+            os_mbuf_free_chain(event->receive.sdu_rx);
+            if (readyNextSdu(event->receive.chan, L2CAP_SDU_SIZE) != 0) {
+                Log.warningln("No L2CAP receive buffer. Closing the channel");
+                ble_l2cap_disconnect(event->receive.chan);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/**
+ * Send the SDUs the publish task queued in l2capQueue. Runs on the host task, the only task that
+ * frees channels, so the channel cannot close during a send
+ *
+ * @param event - The queue's event (unused)
+ */
+void sendQueuedSdus(ble_npl_event *event) {
+    os_mbuf *sdu;
+    while ((sdu = os_mqueue_get(&l2capQueue)) != nullptr) {
+        l2capQueued.fetch_sub(1, std::memory_order_relaxed);
+
+        // The SDU was sized for the channel, so one that closed meanwhile drops it
+        ble_l2cap_chan *channel = l2capChannel;
+        const int rc = channel != nullptr ? ble_l2cap_send(channel, sdu) : BLE_HS_ENOTCONN;
+
+        // A stalled SDU is kept and finished as credits arrive. Only refused SDUs are still ours
+        if (rc == BLE_HS_EBUSY || rc == BLE_HS_EBADDATA || rc == BLE_HS_ENOTCONN) {
+            os_mbuf_free_chain(sdu);
+        }
+        if (rc != 0 && rc != BLE_HS_ESTALLED) {
+            l2capDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Open an L2CAP channel to the client's L2CAP_PSM. Samples keep going out as notifications until
+ * it opens. Ignored while a channel is already opening or open
+ */
+void openL2capChannel() {
+    if (l2capConnecting) {
+        Log.infoln("L2CAP channel already open or opening");
+        return;
+    }
+
+    os_mbuf *sduRx = os_msys_get_pkthdr(L2CAP_SDU_SIZE, 0);
+    if (sduRx == nullptr) {
+        Log.warningln("No L2CAP receive buffer. Using notifications");
+        return;
+    }
+
+    l2capConnecting = true;
+    const int rc = ble_l2cap_connect(connHandle, L2CAP_PSM, L2CAP_SDU_SIZE, sduRx, l2capEvent,
+                                     nullptr);
+    if (rc != 0) {
+        // The same code can come before or after a channel took the buffer. A channel that took
+        // it frees it, and reports itself disconnected first, which clears l2capConnecting
+        if (l2capConnecting) {
+            os_mbuf_free_chain(sduRx);
+        }
+        l2capConnecting = false;
+        Log.warningln("Failed to open an L2CAP channel (code %d). Using notifications", rc);
+    }
+}
+
+/**
+ * Apply a command written to the control characteristic
+ *
+ * @param data - The command bytes [ImuCommand][args...]
+ * @param length - The number of command bytes
+ */
+void handleCommand(const uint8_t *data, size_t length) {
+    if (length == 0) {
+        Log.warningln("Empty control command");
+        return;
+    }
+
+    switch (static_cast<ImuCommand>(data[0])) {
+        case ImuCommand::SET_FORMAT: {
+            if (length < 2 || data[1] >= static_cast<uint8_t>(ImuFormat::COUNT) ||
+                data[1] == static_cast<uint8_t>(ImuFormat::BATCH) ||
+                !(ImuCodec::supportedFormats() & formatBit(static_cast<ImuFormat>(data[1])))) {
+                Log.warningln("Unsupported IMU format requested");
+                return;
+            }
+
+            // EXTENDED also carries the field mask, which must include the quaternion
+            uint8_t fields = fieldBit(ImuField::QUATERNION);
+            if (static_cast<ImuFormat>(data[1]) == ImuFormat::EXTENDED) {
+                if (length < 3 || ImuCodec::packetSize(ImuFormat::EXTENDED, data[2]) == 0) {
+                    Log.warningln("Unsupported IMU fields requested");
+                    return;
+                }
+                fields = data[2];
+            }
+
+            imuFields = fields;
+            imuFormat = static_cast<ImuFormat>(data[1]);
+            Log.infoln("IMU format set to %d (%d byte packets)", data[1],
+                       static_cast<int>(ImuCodec::packetSize(imuFormat, imuFields)));
+            break;
+        }
+        case ImuCommand::SET_PROFILE: {
+            if (length < 2 || data[1] >= static_cast<uint8_t>(ImuProfile::COUNT)) {
+                Log.warningln("Unknown IMU profile requested");
+                return;
+            }
+
+            if (IMU_MODE != ImuMode::DMP) {
+                Log.warningln("IMU profiles only apply in DMP mode");
+                return;
+            }
+
+            // The IMU task owns the bus, so it applies the profile between FIFO reads
+            requestedProfile = static_cast<ImuProfile>(data[1]);
+            Log.infoln("IMU profile %s requested", DMP_PROFILES[data[1]].name);
+            break;
+        }
+        case ImuCommand::SET_BATCH: {
+            if (length < 3 || data[1] == 0) {
+                Log.warningln("Invalid IMU batch requested");
+                return;
+            }
+
+            // The publish task reads these per sample, so a change applies from the next batch
+            batchDelay = data[2];
+            batchLimit = data[1];
+            Log.infoln("IMU batches set to %d samples or %d ms", data[1], data[2]);
+            break;
+        }
+        case ImuCommand::SET_TRANSPORT: {
+            if (length < 2 || data[1] >= static_cast<uint8_t>(ImuTransport::COUNT) ||
+                !(SUPPORTED_TRANSPORTS & transportBit(static_cast<ImuTransport>(data[1])))) {
+                Log.warningln("Unsupported IMU transport requested");
+                return;
+            }
+
+            if (static_cast<ImuTransport>(data[1]) == ImuTransport::L2CAP) {
+                openL2capChannel();
+            } else if (l2capChannel != nullptr) {
+                ble_l2cap_disconnect(l2capChannel);
+            }
+            Log.infoln("IMU transport %d requested", data[1]);
+            break;
+        }
+        default:
+            Log.warningln("Unknown control command %d", data[0]);
+    }
+}
+
+//================================================================================================//
+
 /**
  * A struct to define what to do for characteristic events
  */
 struct CharacteristicCallbacks final : public NimBLECharacteristicCallbacks {
     /**
-     * Called for write events
+     * Called for write events. Applies commands written to the control characteristic
      *
      * @param characteristicWrittenTo - The characteristic that was written to
      * @param connInfo - The connection info
@@ -158,6 +535,11 @@ struct CharacteristicCallbacks final : public NimBLECharacteristicCallbacks {
         Log.trace(characteristicWrittenTo->toString().c_str());
         Log.trace(" written to value: ");
         Log.traceln(characteristicWrittenTo->getValue().c_str());
+
+        if (characteristicWrittenTo == controlCharacteristic) {
+            const NimBLEAttValue value = characteristicWrittenTo->getValue();
+            handleCommand(value.data(), value.length());
+        }
     }
 
     /**
@@ -200,6 +582,39 @@ void restart() {
     ESP.restart();
 }
 
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+/**
+ * Start the broadcast: a non-connectable extended advertising set naming the service, and the
+ * periodic advertising train the samples go out in. Connected clients are unaffected if it fails
+ */
+void startBroadcast() {
+    NimBLEExtAdvertisement announcement;
+    announcement.setConnectable(false);
+    announcement.setScannable(false);
+    announcement.setCompleteServices(NimBLEUUID(SERVICE_UUID));
+    NimBLEExtAdvertising *advertising = NimBLEDevice::getAdvertising();
+    if (!advertising->setInstanceData(BROADCAST_SID, announcement)) {
+        Log.warningln("Failed to configure the IMU broadcast");
+        return;
+    }
+
+    ble_gap_periodic_adv_params params{};
+    params.itvl_min = BROADCAST_INTERVAL;
+    params.itvl_max = BROADCAST_INTERVAL;
+    int rc = ble_gap_periodic_adv_configure(BROADCAST_SID, &params);
+    if (rc == 0) {
+        rc = ble_gap_periodic_adv_start(BROADCAST_SID);
+    }
+    if (rc != 0 || !advertising->start(BROADCAST_SID)) {
+        Log.warningln("Failed to start the IMU broadcast (code %d)", rc);
+        return;
+    }
+
+    broadcasting = true;
+    Log.infoln("Broadcasting IMU samples every %d us", BROADCAST_INTERVAL * 1250);
+}
+#endif
+
 /**
  * Establish a BLE server and begin advertising. It creates the device, server, service, and
  * characteristics. It then starts the service and begins advertising
@@ -210,6 +625,7 @@ void restart() {
 void setupBLEServer() {
     // Initialize BLE Device
     NimBLEDevice::init(DEVICE_NAME);
+    os_mqueue_init(&l2capQueue, sendQueuedSdus, nullptr);
     Log.traceln("BLE device created");
 
     // Create the server
@@ -228,6 +644,17 @@ void setupBLEServer() {
     IMUCharacteristic->setCallbacks(&characteristicCallback);
     Log.traceln("IMU Characteristic created");
 
+    // The control characteristic reads as [version][supported formats][supported fields] and
+    // accepts commands
+    controlCharacteristic = eyeballService->createCharacteristic(CONTROL_CHARACTERISTIC_UUID,
+                                                                 NIMBLE_PROPERTY::READ |
+                                                                 NIMBLE_PROPERTY::WRITE);
+    controlCharacteristic->setCallbacks(&characteristicCallback);
+    const uint8_t capabilities[] = {PROTOCOL_VERSION, ImuCodec::supportedFormats(),
+                                    ImuCodec::supportedFields(), SUPPORTED_TRANSPORTS};
+    controlCharacteristic->setValue(capabilities, sizeof(capabilities));
+    Log.traceln("Control Characteristic created");
+
     // todo Create other characteristics here (battery life)
 
     // Start the service
@@ -235,24 +662,489 @@ void setupBLEServer() {
     eyeballService->start();
 
     // Set up and start advertising
+#if CONFIG_BT_NIMBLE_EXT_ADV
+    // Legacy PDUs, so clients without extended scanning still find the server
+    NimBLEExtAdvertisement connectable;
+    connectable.setLegacyAdvertising(true);
+    connectable.setConnectable(true);
+    connectable.setCompleteServices(NimBLEUUID(SERVICE_UUID));
+    NimBLEExtAdvertising *advertising = NimBLEDevice::getAdvertising();
+    advertising->setInstanceData(CONNECTABLE_INSTANCE, connectable);
+    Log.traceln("Starting advertising");
+    advertising->start(CONNECTABLE_INSTANCE);
+#else
     NimBLEAdvertising *advertising = NimBLEDevice::getAdvertising();
     advertising->addServiceUUID(SERVICE_UUID);
     advertising->setScanResponse(false);
     Log.traceln("Starting advertising");
     advertising->start();
+#endif
+
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+    startBroadcast();
+#endif
 
     Log.infoln("BLE Server setup successful");
 }
 
 /**
- * Interrupt service routine for when the IMU's interrupt pin goes high
+ * Interrupt service routine for when the IMU's interrupt pin goes high. Wakes the IMU task (or
+ * the raw IMU task in RAW mode)
  */
-void DMPDataReady() { interrupt = true; }
+void IRAM_ATTR DMPDataReady() {
+    dataReadyTime = micros();
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(IMUTaskHandle, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/**
+ * Called by I2CdevAsync when a FIFO burst read completes
+ *
+ * @param result - The result of the read
+ * @param arg - Unused
+ */
+void burstReadComplete(esp_err_t result, void *arg) {
+    burstResult = result;
+    xSemaphoreGive(burstDone);
+}
+
+/**
+ * Queue an asynchronous read of whole packets from the FIFO
+ *
+ * @param burst - Where to store the packets
+ * @param count - The number of packets to read
+ * @return True if the read was queued
+ */
+bool startBurstRead(uint8_t *burst, uint8_t count) {
+    return I2CdevAsync::readBytes(MPU6050_DEFAULT_ADDRESS, MPU6050_RA_FIFO_R_W,
+                                  count * DMP_PACKET_SIZE, burst, burstReadComplete);
+}
+
+/**
+ * Copy a burst of packets into the sample ring. Every packet takes a sequence number, even those
+ * the full ring refuses, so the client sees the loss as a gap. The FIFO only holds the packets,
+ * so each is back-dated from the newest by one output period per packet queued after it
+ *
+ * @param burst - The packets, oldest first
+ * @param count - The number of packets
+ * @param newestTime - When the newest packet in the FIFO was ready
+ * @param after - The number of packets queued in the FIFO after this burst
+ * @param period - The DMP output period in us
+ */
+void storeBurst(const uint8_t *burst, uint8_t count, uint32_t newestTime, uint16_t after,
+                uint32_t period) {
+    for (uint8_t i(0); i < count; ++i) {
+        const uint32_t timestamp = newestTime - (after + count - 1 - i) * period;
+        const uint16_t sequence = nextSequence++;
+        DmpSample *sample = samples.claim();
+        if (sample == nullptr) {
+            continue;
+        }
+
+        sample->timestamp = timestamp;
+        sample->sequence = sequence;
+        memcpy(sample->packet, &burst[i * DMP_PACKET_SIZE], DMP_PACKET_SIZE);
+        samples.publish();
+    }
+}
+
+/**
+ * Switch the DMP output rate and low-pass filter. The rate divisor lives in the DMP firmware
+ * image, where dmpInitialize writes MPU6050_DMP_FIFO_RATE_DIVISOR. The FIFO is reset after, since
+ * packets already in it were produced under the old profile
+ *
+ * @param profile - The profile to apply
+ */
+void applyProfile(ImuProfile profile) {
+    const DmpProfile &settings = DMP_PROFILES[static_cast<uint8_t>(profile)];
+    const uint8_t rateDivisor[] = {0x00, settings.rateDivisor};
+
+    mpu.writeMemoryBlock(rateDivisor, sizeof(rateDivisor), 0x02, 0x16);
+    mpu.setDLPFMode(settings.DLPFMode);
+    mpu.resetFIFO();
+    activeProfile = profile;
+
+    Log.infoln("IMU profile set to %s (%d Hz output, %F ms datasheet filter delay)",
+               settings.name, 200 / (1 + settings.rateDivisor), settings.filterDelay);
+}
+
+/**
+ * A freeRTOS task that drains the DMP's FIFO. Each interrupt it takes the FIFO count once and
+ * reads every whole packet, up to PACKETS_PER_READ per I2C transaction, into the sample
+ * ring. The reads are double buffered through I2CdevAsync, so each burst is stored while the next
+ * is on the bus. An overflowed FIFO is misaligned, so it is reset and its contents counted as lost
+ *
+ * Profile changes are applied between reads. For PROFILE_MEASURE_TIME after each one, it counts
+ * the packets read to report the measured output rate. The delay it reports with it is only an
+ * estimate, never timed: the datasheet filter delay plus, on average, half a measured output
+ * period waiting for the DMP
+ *
+ * @param param - Any parameters to be used by the task (none)
+ */
+[[noreturn]] void IMUTask(void *param) {
+    uint32_t lostLogged = 0;
+    uint32_t measureStart = micros();
+    uint32_t measuredPackets = 0;
+    bool measuring = true;
+    uint32_t wake = micros();
+    uint32_t waited = 0;
+
+    while (true) {
+        // The last pass was busy, except while its reads were on the bus
+        IMUBusyTime.fetch_add(micros() - wake - waited, std::memory_order_relaxed);
+
+        // Time out in case an interrupt edge is missed
+        const bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IMU_WAIT_TIMEOUT)) > 0;
+        wake = micros();
+        waited = 0;
+
+        if (requestedProfile != activeProfile) {
+            applyProfile(requestedProfile);
+            measureStart = micros();
+            measuredPackets = 0;
+            measuring = true;
+            continue;
+        }
+
+        // Reading the status also clears the IMU's interrupt
+        const uint8_t status = mpu.getIntStatus();
+        uint16_t fifoCount = mpu.getFIFOCount();
+
+        // The interrupt marks the newest packet counted, unless it was missed
+        const uint32_t newestTime = notified ? dataReadyTime : micros();
+        const uint32_t period =
+            5000 * (1 + DMP_PROFILES[static_cast<uint8_t>(activeProfile)].rateDivisor);
+
+        if ((status & (1 << MPU6050_INTERRUPT_FIFO_OFLOW_BIT)) || fifoCount >= FIFO_SIZE) {
+            mpu.resetFIFO();
+            ++fifoOverflows;
+            Log.warningln("IMU FIFO overflowed - reset (%d overflows)", fifoOverflows);
+            continue;
+        }
+
+        uint16_t packets = fifoCount / DMP_PACKET_SIZE;
+        uint8_t buffer = 0;
+        uint8_t count = min(packets, static_cast<uint16_t>(PACKETS_PER_READ));
+        bool inFlight = count > 0 && startBurstRead(IMUBursts[buffer], count);
+        bool failed = false;
+
+        while (inFlight) {
+            const uint32_t waitStart = micros();
+            xSemaphoreTake(burstDone, portMAX_DELAY);
+            waited += micros() - waitStart;
+            const uint8_t *burst = IMUBursts[buffer];
+            const uint8_t burstCount = count;
+            packets -= count;
+
+            if (burstResult != ESP_OK) {
+                failed = true;
+                break;
+            }
+
+            // Put the next burst on the bus before storing this one
+            buffer ^= 1;
+            count = min(packets, static_cast<uint16_t>(PACKETS_PER_READ));
+            inFlight = count > 0 && startBurstRead(IMUBursts[buffer], count);
+
+            storeBurst(burst, burstCount, newestTime, packets, period);
+            measuredPackets += burstCount;
+        }
+
+        // A failed read leaves the FIFO misaligned
+        if (failed) {
+            mpu.resetFIFO();
+            Log.warningln("IMU FIFO read failed (%d) - reset", burstResult);
+        }
+
+        const uint32_t elapsed = micros() - measureStart;
+        if (measuring && elapsed >= PROFILE_MEASURE_TIME * 1000) {
+            const float rate = measuredPackets * 1e6f / static_cast<float>(elapsed);
+            const float estimatedDelay = DMP_PROFILES[static_cast<uint8_t>(activeProfile)].filterDelay +
+                                (rate > 0.0f ? 500.0f / rate : 0.0f);
+            Log.noticeln("IMU profile %s: %F Hz measured output, %F ms estimated mean delay",
+                         DMP_PROFILES[static_cast<uint8_t>(activeProfile)].name, rate,
+                         estimatedDelay);
+            measuring = false;
+        }
+
+        if (samples.getLost() != lostLogged) {
+            lostLogged = samples.getLost();
+            Log.warningln("Sample ring full (%d samples lost)", lostLogged);
+        }
+
+        xTaskNotifyGive(publishTaskHandle);
+    }
+}
+
+/**
+ * Write a big-endian 32 bit word into a DMP packet
+ *
+ * @param out - Where to write the word
+ * @param value - The word
+ */
+void writeDmpWord(uint8_t *out, int32_t value) {
+    const uint32_t word = static_cast<uint32_t>(value);
+    out[0] = word >> 24;
+    out[1] = word >> 16;
+    out[2] = word >> 8;
+    out[3] = word;
+}
+
+/**
+ * Store a filtered raw sample in the sample ring in the DMP's packet layout: the quaternion in
+ * Q30, then the raw gyro and accel readings as the high words of their values. The raw full scale
+ * ranges match the DMP's packet units, so every format encodes it unchanged. Like storeBurst, it
+ * takes a sequence number even if the ring refuses it
+ *
+ * @param q - The filtered orientation {w, x, y, z}
+ * @param gyro - The raw gyro reading [x,y,z]
+ * @param accel - The raw accel reading [x,y,z]
+ * @param timestamp - When the reading was taken
+ */
+void storeRawSample(const std::array<float, 4> &q, const int16_t *gyro, const int16_t *accel,
+                    uint32_t timestamp) {
+    const uint16_t sequence = nextSequence++;
+    DmpSample *sample = samples.claim();
+    if (sample == nullptr) {
+        return;
+    }
+
+    sample->timestamp = timestamp;
+    sample->sequence = sequence;
+    memset(sample->packet, 0, DMP_PACKET_SIZE);
+    for (uint8_t i(0); i < 4; ++i) {
+        writeDmpWord(&sample->packet[4 * i], static_cast<int32_t>(q[i] * Q30_SCALE));
+    }
+    for (uint8_t i(0); i < 3; ++i) {
+        writeDmpWord(&sample->packet[16 + 4 * i], static_cast<int32_t>(gyro[i]) * 65536);
+        writeDmpWord(&sample->packet[28 + 4 * i], static_cast<int32_t>(accel[i]) * 65536);
+    }
+    samples.publish();
+}
+
+/**
+ * A freeRTOS task that runs the orientation filter in RAW mode. Each data ready interrupt it
+ * reads one gyro and accel sample, integrates it over the time since the last, and every
+ * RAW_OUTPUT_DIVISOR samples stores the result in the sample ring
+ *
+ * For PROFILE_MEASURE_TIME after starting, it counts samples and times the filter to report the
+ * measured sample rate and the cost of each update
+ *
+ * @param param - Any parameters to be used by the task (none)
+ */
+[[noreturn]] void RawIMUTask(void *param) {
+    OrientationFilter filter(RAW_FILTER, RAW_FILTER_KP, RAW_FILTER_KI);
+    int16_t accel[3], gyro[3];
+    uint8_t untilOutput = RAW_OUTPUT_DIVISOR;
+    uint32_t lostLogged = 0;
+    uint32_t prevTime = micros();
+    const uint32_t measureStart = prevTime;
+    uint32_t measuredSamples = 0;
+    uint32_t filterTime = 0;
+    bool measuring = true;
+    uint32_t wake = prevTime;
+
+    while (true) {
+        IMUBusyTime.fetch_add(micros() - wake, std::memory_order_relaxed);
+
+        // Time out in case an interrupt edge is missed
+        const bool notified = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(IMU_WAIT_TIMEOUT)) > 0;
+        wake = micros();
+        mpu.getMotion6(&accel[0], &accel[1], &accel[2], &gyro[0], &gyro[1], &gyro[2]);
+
+        // The sample was taken when its interrupt fired, not when the read finished
+        const uint32_t timestamp = notified ? dataReadyTime : wake;
+        const uint32_t filterStart = micros();
+        const float dt = (timestamp - prevTime) * 1e-6f;
+        prevTime = timestamp;
+
+        filter.update(gyro[0] * RAW_GYRO_SCALE, gyro[1] * RAW_GYRO_SCALE, gyro[2] * RAW_GYRO_SCALE,
+                      accel[0], accel[1], accel[2], dt);
+
+        if (--untilOutput == 0) {
+            untilOutput = RAW_OUTPUT_DIVISOR;
+            storeRawSample(filter.getQuaternion(), gyro, accel, timestamp);
+            xTaskNotifyGive(publishTaskHandle);
+        }
+
+        if (measuring) {
+            ++measuredSamples;
+            filterTime += micros() - filterStart;
+
+            const uint32_t elapsed = timestamp - measureStart;
+            if (elapsed >= PROFILE_MEASURE_TIME * 1000) {
+                Log.noticeln("Raw IMU measured: %F Hz sample rate, %F us per filter update",
+                             measuredSamples * 1e6f / static_cast<float>(elapsed),
+                             filterTime / static_cast<float>(measuredSamples));
+                measuring = false;
+            }
+        }
+
+        if (samples.getLost() != lostLogged) {
+            lostLogged = samples.getLost();
+            Log.warningln("Sample ring full (%d samples lost)", lostLogged);
+        }
+    }
+}
+
+/**
+ * Get the IMU's temperature
+ *
+ * @return The temperature in deg C
+ */
+float getIMUTemperature() { return mpu.getTemperature() / 340.0f + 36.53f; }
+
+/**
+ * Load saved offsets into the IMU
+ *
+ * @param temperature - Where to store the temperature they were calibrated at
+ * @return True if there were saved offsets
+ */
+bool loadCalibration(float &temperature) {
+    calibrationStore.begin("imu", true);
+    const bool saved = calibrationStore.isKey("temperature");
+
+    if (saved) {
+        mpu.setXAccelOffset(calibrationStore.getShort("xAccel"));
+        mpu.setYAccelOffset(calibrationStore.getShort("yAccel"));
+        mpu.setZAccelOffset(calibrationStore.getShort("zAccel"));
+        mpu.setXGyroOffset(calibrationStore.getShort("xGyro"));
+        mpu.setYGyroOffset(calibrationStore.getShort("yGyro"));
+        mpu.setZGyroOffset(calibrationStore.getShort("zGyro"));
+        temperature = calibrationStore.getFloat("temperature");
+    }
+
+    calibrationStore.end();
+    return saved;
+}
+
+/**
+ * Save the IMU's active offsets and the current temperature
+ */
+void saveCalibration() {
+    calibrationStore.begin("imu", false);
+    calibrationStore.putShort("xAccel", mpu.getXAccelOffset());
+    calibrationStore.putShort("yAccel", mpu.getYAccelOffset());
+    calibrationStore.putShort("zAccel", mpu.getZAccelOffset());
+    calibrationStore.putShort("xGyro", mpu.getXGyroOffset());
+    calibrationStore.putShort("yGyro", mpu.getYGyroOffset());
+    calibrationStore.putShort("zGyro", mpu.getZGyroOffset());
+    calibrationStore.putFloat("temperature", getIMUTemperature());
+    calibrationStore.end();
+    Log.traceln("Saved calibration offsets");
+}
+
+/**
+ * Check that the loaded offsets still hold by averaging raw readings while the IMU is still and
+ * level. Gyro rates and horizontal acceleration should be zero, and vertical acceleration 1 g
+ *
+ * @return True if the residual bias is within the limits
+ */
+bool checkResidualBias() {
+    const float gravity = static_cast<float>(16384 >> mpu.getFullScaleAccelRange());
+    float sums[6] = {};
+    int16_t ax, ay, az, gx, gy, gz;
+
+    for (uint8_t i(0); i < RESIDUAL_SAMPLES; ++i) {
+        mpu.getMotion6(&ax, &ay, &az, &gx, &gy, &gz);
+        sums[0] += ax;
+        sums[1] += ay;
+        sums[2] += az - gravity;
+        sums[3] += gx;
+        sums[4] += gy;
+        sums[5] += gz;
+        delay(5); // One 200 Hz sample period
+    }
+
+    float accelResidual(0.0f), gyroResidual(0.0f);
+    for (uint8_t i(0); i < 3; ++i) {
+        accelResidual = max(accelResidual, fabsf(sums[i] / RESIDUAL_SAMPLES));
+        gyroResidual = max(gyroResidual, fabsf(sums[i + 3] / RESIDUAL_SAMPLES));
+    }
+
+    const bool passed = accelResidual <= MAX_ACCEL_RESIDUAL && gyroResidual <= MAX_GYRO_RESIDUAL;
+    if (passed) {
+        Log.traceln("Residual bias - accel: %F LSB, gyro: %F LSB", accelResidual, gyroResidual);
+    } else {
+        Log.warningln("Residual bias too large - accel: %F LSB (max %F), gyro: %F LSB (max %F)",
+                      accelResidual, MAX_ACCEL_RESIDUAL, gyroResidual, MAX_GYRO_RESIDUAL);
+    }
+
+    return passed;
+}
+
+/**
+ * Calibrate the IMU. Saved offsets are used if they pass the residual bias check at about the
+ * temperature they were saved at. Otherwise it runs full calibration and saves the result
+ */
+void calibrateIMU() {
+    float savedTemperature(0.0f);
+    if (!FORCE_CALIBRATION && loadCalibration(savedTemperature)) {
+        const float drift = fabsf(getIMUTemperature() - savedTemperature);
+        if (drift > MAX_TEMPERATURE_DRIFT) {
+            Log.warningln("Temperature drifted %F deg C since calibration - recalibrating", drift);
+        } else if (!checkResidualBias()) {
+            Log.warningln("Saved calibration failed the residual bias check - recalibrating");
+        } else {
+            Log.infoln("Using saved calibration offsets");
+            return;
+        }
+    }
+
+    // Start from the configured offsets rather than whatever failed the check
+    mpu.setXAccelOffset(X_ACCEL_OFFSET);
+    mpu.setYAccelOffset(Y_ACCEL_OFFSET);
+    mpu.setZAccelOffset(Z_ACCEL_OFFSET);
+    mpu.setXGyroOffset(X_GYRO_OFFSET);
+    mpu.setYGyroOffset(Y_GYRO_OFFSET);
+    mpu.setZGyroOffset(Z_GYRO_OFFSET);
+
+    // Generate calibration values
+    Log.traceln("Generating calibration values:");
+    mpu.CalibrateAccel();
+    mpu.CalibrateGyro();
+    mpu.PrintActiveOffsets();
+    saveCalibration();
+}
+
+/**
+ * Sets up the IMU for RAW mode. It calibrates at the DMP's gyro range, then sets the ranges,
+ * sample rate, and filter for raw samples and enables the data ready interrupt. The raw IMU task
+ * is started before the interrupt is attached
+ *
+ * @param setupStart - millis() when IMU setup began
+ */
+void setupRawIMU(uint32_t setupStart) {
+    mpu.setFullScaleGyroRange(MPU6050_GYRO_FS_2000);
+    calibrateIMU();
+
+    // 8192 LSB per g, the DMP packet's accel unit
+    mpu.setFullScaleAccelRange(MPU6050_ACCEL_FS_4);
+    mpu.setDLPFMode(RAW_DLPF_MODE);
+    mpu.setRate(RAW_RATE_DIVISOR);
+    mpu.setIntDataReadyEnabled(true);
+
+    // Create the task that runs the filter
+    BaseType_t IMUResult = xTaskCreatePinnedToCore(RawIMUTask, "RawIMUTask", IMU_STACK_SIZE,
+                                                   nullptr, 2, &IMUTaskHandle, IMU_CORE);
+    if (IMUResult != pdPASS) {
+        Log.errorln("Failed to create RawIMUTask");
+        restart();
+    }
+
+    attachInterrupt(digitalPinToInterrupt(INTERRUPT_PIN), DMPDataReady, RISING);
+    Log.traceln("Enabled interrupt detection on pin %d", INTERRUPT_PIN);
+
+    IMUInit = true;
+    Log.infoln("Raw IMU setup successful (%d ms)", static_cast<int>(millis() - setupStart));
+}
 
 /**
  * Sets up the IMU to read DMP data. It joins the I2C bus and verifies that connection. It
- * configures the DMP, gathers calibration offsets, gets packet size, and enables DMP use if
- * successful
+ * configures the DMP, gathers calibration offsets, checks the packet size, and enables DMP use if
+ * successful. The IMU task is started before the interrupt is attached. In RAW mode the DMP is
+ * skipped and setupRawIMU takes over after the connection check
  */
 void setupIMU() {
     // Join I2C bus
@@ -274,29 +1166,44 @@ void setupIMU() {
         restart();
     }
 
+    const uint32_t setupStart = millis();
+    if (IMU_MODE == ImuMode::RAW) {
+        setupRawIMU(setupStart);
+        return;
+    }
+
     // Load and configure the DMP
     DMPStatus = mpu.dmpInitialize();
-    Log.traceln("DMP initialized");
+    Log.traceln("DMP initialized (%d ms)", static_cast<int>(millis() - setupStart));
 
-    // Supply measured offsets
-    mpu.setXAccelOffset(X_ACCEL_OFFSET);
-    mpu.setYAccelOffset(Y_ACCEL_OFFSET);
-    mpu.setZAccelOffset(Z_ACCEL_OFFSET);
-    mpu.setXGyroOffset(X_GYRO_OFFSET);
-    mpu.setYGyroOffset(Y_GYRO_OFFSET);
-    mpu.setZGyroOffset(Z_GYRO_OFFSET);
+    if (DMPStatus == 0 && mpu.dmpGetFIFOPacketSize() != DMP_PACKET_SIZE) {
+        Log.errorln("Unexpected DMP packet size %d", mpu.dmpGetFIFOPacketSize());
+        restart();
+    }
 
     if (DMPStatus == 0) {
-        // Generate calibration values
-        Log.traceln("Generating calibration values:");
-        mpu.CalibrateAccel();
-        mpu.CalibrateGyro();
-        mpu.PrintActiveOffsets();
+        calibrateIMU();
 
-        // Enable the DMP
+        // Enable the DMP and start from an empty FIFO at the boot profile
         mpu.setDMPEnabled(true);
+        applyProfile(IMU_PROFILE);
         Log.traceln("DMP enabled");
 
+        // Start the asynchronous I2C backend on the bus Wire set up
+        burstDone = xSemaphoreCreateBinary();
+        if (burstDone == nullptr || !I2CdevAsync::begin(I2C_NUM_0, 3, 4, IMU_CORE)) {
+            Log.errorln("Failed to start the asynchronous I2C backend");
+            restart();
+        }
+
+        // Create the task that fills the sample ring
+        BaseType_t IMUResult = xTaskCreatePinnedToCore(IMUTask, "IMUTask", IMU_STACK_SIZE,
+                                                       nullptr, 2, &IMUTaskHandle, IMU_CORE);
+        if (IMUResult != pdPASS) {
+            Log.errorln("Failed to create IMUTask");
+            restart();
+        }
+
         // Enable the ESP32 interrupt detection
         attachInterrupt(digitalPinToInterrupt(INTERRUPT_PIN), DMPDataReady, RISING);
       //  interruptStatus = mpu.getIntStatus();
@@ -305,9 +1212,9 @@ void setupIMU() {
         // Get the packet size for comparison
 //        packetSize = mpu.dmpGetFIFOPacketSize();
 
-        // Set the DMPInit flag to true so the main loop knows all went well
-        DMPInit = true;
-        Log.infoln("IMU setup successful");
+        // Set the IMUInit flag to true so the main loop knows all went well
+        IMUInit = true;
+        Log.infoln("IMU setup successful (%d ms)", static_cast<int>(millis() - setupStart));
     } else {
         Log.errorln("DMP initialization failed (code %d)", DMPStatus);
         restart();
@@ -315,18 +1222,239 @@ void setupIMU() {
 }
 
 /**
- * Reads the quaternion data from the DMP and packages it into a 16 byte array
+ * Encodes the quaternion data from the DMP packet in the negotiated format. The DMP_Q14 and
+ * EXTENDED formats forward the fixed-point words untouched, so no float conversion happens on the
+ * server. EXTENDED packets also carry the sample's sequence number and sample time if the client
+ * asked for them
+ *
+ * @param sample - The sample to encode
+ * @param format - The format to encode in
+ * @param fields - The field mask, for EXTENDED packets
+ */
+void packageQuaternionData(const DmpSample &sample, ImuFormat format, uint8_t fields) {
+    quaternionDataLength = ImuCodec::encodeDmpPacket(format, sample.packet, quaternionData,
+                                                     fields, sample.sequence, sample.timestamp);
+    Log.verboseln("\tIMU packet: %d bytes", static_cast<int>(quaternionDataLength));
+}
+
+/**
+ * Send a packet to the client, over the L2CAP channel if it is open and as a notification
+ * otherwise. L2CAP SDUs are queued for the host task to send (see sendQueuedSdus)
+ *
+ * @param data - The packet
+ * @param length - The length of the packet
+ */
+void notifyClient(const uint8_t *data, size_t length) {
+    if (l2capChannel == nullptr) {
+        IMUCharacteristic->setValue(data, length);
+        IMUCharacteristic->notify();
+        return;
+    }
+
+    // A host task that falls behind drops frames rather than draining the mbuf pool
+    if (l2capQueued.load(std::memory_order_relaxed) >= L2CAP_QUEUE_DEPTH) {
+        l2capDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    os_mbuf *sdu = ble_hs_mbuf_from_flat(data, length);
+    if (sdu == nullptr) {
+        l2capDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    l2capQueued.fetch_add(1, std::memory_order_relaxed);
+    if (os_mqueue_put(&l2capQueue, nimble_port_get_dflt_eventq(), sdu) != 0) {
+        l2capQueued.fetch_sub(1, std::memory_order_relaxed);
+        os_mbuf_free_chain(sdu);
+        l2capDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+/**
+ * Put a sample in the periodic advertising train. The train holds the newest BROADCAST_DEPTH
+ * samples as a batch in manufacturer data, replacing what the last sample put there
+ *
+ * @param sample - The sample to broadcast
+ */
+void broadcastSample(const DmpSample &sample) {
+    if (!broadcasting) {
+        return;
+    }
+
+    broadcastPacketLength = static_cast<uint8_t>(ImuCodec::encodeDmpPacket(
+            ImuFormat::EXTENDED, sample.packet, broadcastPackets[broadcastNext], BROADCAST_FIELDS,
+            sample.sequence, sample.timestamp));
+    broadcastNext = (broadcastNext + 1) % BROADCAST_DEPTH;
+    broadcastCount = min(static_cast<uint8_t>(broadcastCount + 1), BROADCAST_DEPTH);
+
+    // [length][0xFF][company ID][BATCH][count][packets, oldest first]
+    uint8_t data[BROADCAST_HEADER_SIZE + BATCH_HEADER_SIZE + BROADCAST_DEPTH * MAX_PACKET_SIZE + 1];
+    uint8_t *batch = &data[BROADCAST_HEADER_SIZE];
+    size_t length = BATCH_HEADER_SIZE;
+    for (uint8_t i(0); i < broadcastCount; ++i) {
+        const uint8_t index = (broadcastNext + BROADCAST_DEPTH - broadcastCount + i) %
+                              BROADCAST_DEPTH;
+        memcpy(&batch[length], broadcastPackets[index], broadcastPacketLength);
+        length += broadcastPacketLength;
+    }
+    length = ImuCodec::finishBatch(batch, length, broadcastCount) + BROADCAST_HEADER_SIZE;
+    data[0] = length - 1;
+    data[1] = BLE_HS_ADV_TYPE_MFG_DATA;
+    data[2] = BROADCAST_COMPANY_ID & 0xFF;
+    data[3] = BROADCAST_COMPANY_ID >> 8;
+
+    // The train data is consumed whether or not it is taken
+    os_mbuf *train = ble_hs_mbuf_from_flat(data, length);
+    if (train == nullptr || ble_gap_periodic_adv_set_data(BROADCAST_SID, train) != 0) {
+        broadcastFailed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+#endif
+
+/**
+ * Send the batch being filled, if it holds any samples, and start a new one
+ */
+void flushBatch() {
+    if (batchCount > 0) {
+        notifyClient(batch, ImuCodec::finishBatch(batch, batchLength, batchCount));
+    }
+
+    batchLength = BATCH_HEADER_SIZE;
+    batchCount = 0;
+}
+
+/**
+ * Send a sample to the client. Without batching it is sent alone. Otherwise it is added to the
+ * batch, which is sent first if the sample would overflow the MTU, and after if the batch is full
+ *
+ * @param sample - The sample to send
+ */
+void publishSample(const DmpSample &sample) {
+    // The client may change these mid-sample, so each is read once
+    const ImuFormat format = imuFormat;
+    const uint8_t limit = batchLimit;
+    packageQuaternionData(sample, format, imuFields);
+
+    // The legacy format has no format byte to batch with
+    const size_t capacity = min(static_cast<size_t>(l2capChannel != nullptr ? l2capMTU.load() :
+                                                    peerMTU.load() - 3), MAX_NOTIFICATION_SIZE);
+    if (limit <= 1 || format == ImuFormat::LEGACY ||
+        BATCH_HEADER_SIZE + quaternionDataLength > capacity) {
+        flushBatch();
+        notifyClient(quaternionData, quaternionDataLength);
+        return;
+    }
+
+    // A batch holds one format, so a format change mid-batch starts a new one
+    if (batchLength + quaternionDataLength > capacity ||
+        (batchCount > 0 && batch[BATCH_HEADER_SIZE] != quaternionData[0])) {
+        flushBatch();
+    }
+
+    memcpy(&batch[batchLength], quaternionData, quaternionDataLength);
+    batchLength += quaternionDataLength;
+    if (batchCount++ == 0) {
+        batchDeadline = sample.timestamp + batchDelay * 1000;
+    }
+
+    if (batchCount >= limit) {
+        flushBatch();
+    }
+}
+
+/**
+ * A freeRTOS task that publishes samples. Each time the IMU task fills the sample ring, it sends
+ * every sample in it in order if a client is connected, and drops them otherwise. Broadcast builds
+ * also put every sample in the periodic advertising train. A partly filled
+ * batch is sent once its oldest sample reaches the deadline, so the task also wakes for that. It
+ * runs on the NimBLE host's core, so notifications are handed to the host without crossing cores
+ *
+ * @param param - Any parameters to be used by the task (none)
+ */
+[[noreturn]] void publishTask(void *param) {
+    uint32_t wake = micros();
+
+    while (true) {
+        publishBusyTime.fetch_add(micros() - wake, std::memory_order_relaxed);
+
+        // Time out in case a notification from the IMU task is missed, or for the batch deadline
+        TickType_t wait = pdMS_TO_TICKS(IMU_WAIT_TIMEOUT);
+        if (batchCount > 0) {
+            const auto remaining = static_cast<int32_t>(batchDeadline - micros());
+            wait = remaining > 0 ? min(wait, pdMS_TO_TICKS(remaining / 1000 + 1)) : 0;
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait);
+        wake = micros();
+
+        const uint32_t depth = samples.size();
+        if (depth > maxQueueDepth.load(std::memory_order_relaxed)) {
+            maxQueueDepth.store(depth, std::memory_order_relaxed);
+        }
+
+        for (const DmpSample *sample = samples.peek(); sample != nullptr;
+             sample = samples.peek()) {
+            if (connected) {
+                publishSample(*sample);
+            }
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+            broadcastSample(*sample);
+#endif
+
+            samples.release();
+        }
+
+        if (!connected) {
+            batchLength = BATCH_HEADER_SIZE;
+            batchCount = 0;
+        } else if (batchCount > 0 && static_cast<int32_t>(micros() - batchDeadline) >= 0) {
+            flushBatch();
+        }
+    }
+}
+
+/**
+ * Start the publish task on PUBLISH_CORE. It must exist before the IMU task, which wakes it
  */
-void packageQuaternionData() {
-    mpu.dmpGetQuaternion(&quaternion, fifoBuffer);
-    memcpy(&quaternionData[0], &quaternion.w, sizeof(float));
-    memcpy(&quaternionData[4], &quaternion.x, sizeof(float));
-    memcpy(&quaternionData[8], &quaternion.y, sizeof(float));
-    memcpy(&quaternionData[12], &quaternion.z, sizeof(float));
+void setupPublishTask() {
+    BaseType_t publishResult = xTaskCreatePinnedToCore(publishTask, "PublishTask", 3072, nullptr,
+                                                       2, &publishTaskHandle, PUBLISH_CORE);
+    if (publishResult != pdPASS) {
+        Log.errorln("Failed to create publishTask");
+        restart();
+    }
 
-    Log.verboseln("\tQuat:\t%D\t%D\t%D\t%D", quaternion.w, quaternion.x, quaternion.y, quaternion
-            .z);
-} //todo do i need this? Can it be more efficient as in just sent quaternion itself
+    Log.traceln("Publish task started on core %d", PUBLISH_CORE);
+}
+
+/**
+ * Log each pipeline task's share of its core, the deepest the sample ring got since the last
+ * report and the least stack each task has had free, then start the next report period.
+ * Broadcast builds also log failed train updates
+ *
+ * @param elapsed - us since the last report
+ */
+void reportPipeline(uint32_t elapsed) {
+    const float IMULoad = IMUBusyTime.exchange(0, std::memory_order_relaxed) * 100.0f / elapsed;
+    const float publishLoad = publishBusyTime.exchange(0, std::memory_order_relaxed) * 100.0f /
+                              elapsed;
+    Log.noticeln("Pipeline: IMU task %F%% of core %d, publish task %F%% of core %d, ring depth "
+                 "%d max of %d, %d L2CAP frames dropped", IMULoad, IMU_CORE, publishLoad,
+                 PUBLISH_CORE,
+                 static_cast<int>(maxQueueDepth.exchange(0, std::memory_order_relaxed)),
+                 static_cast<int>(DmpSampleRing::capacity()),
+                 static_cast<int>(l2capDropped.exchange(0, std::memory_order_relaxed)));
+    Log.noticeln("Stack headroom: IMU task %d bytes, publish task %d bytes, I2C worker %d bytes",
+                 static_cast<int>(uxTaskGetStackHighWaterMark(IMUTaskHandle)),
+                 static_cast<int>(uxTaskGetStackHighWaterMark(publishTaskHandle)),
+                 static_cast<int>(I2CdevAsync::stackHeadroom()));
+#if CONFIG_BT_NIMBLE_ENABLE_PERIODIC_ADV
+    Log.noticeln("Broadcast: %d periodic advertising updates failed",
+                 static_cast<int>(broadcastFailed.exchange(0, std::memory_order_relaxed)));
+#endif
+}
 
 /**
  * Perform the setup for the program. Creates and initializes the BLE server and MPU6050
@@ -351,6 +1479,7 @@ void setup() {
 
     NimBLEAddress macAddress = NimBLEDevice::getAddress();
     Log.infoln("Server MAC Address: %s", macAddress.toString().c_str());
+    setupPublishTask();
 
 
     //Set up the IMU
@@ -369,38 +1498,22 @@ void setup() {
 }
 
 /**
- * Main program loop to manage getting quaternion data from the DMP and transmitting it to the
- * client. If the client is connected, it gets the latest quaternion packet, packages it, and
- * then notifies the client. It handles reestablishing connections and disconnections
+ * Main program loop. Sampling and publishing run in their own tasks, so it only restarts
+ * advertising after a disconnect and reports the pipeline's load
  */
 void loop() {
+    static uint32_t lastReport = micros();
 
-    if (mpu.dmpGetCurrentFIFOPacket(fifoBuffer)) {
-        packageQuaternionData();
-        Log.infoln("%D,%D,%D,%D", quaternion.w, quaternion.x, quaternion.y, quaternion
-                .z);
+    if (!IMUInit) {
+        Log.errorln("IMU not initialized successfully");
+        restart();
     }
-    try {
-        // Notify the client that the IMU data has changed
-        if (connected) {
-            if (!DMPInit) {
-                Log.errorln("DMP not initialized successfully");
-                restart();
-            }
-
-            // Get the latest packet and transmit it
-            if (mpu.dmpGetCurrentFIFOPacket(fifoBuffer)) {
-                packageQuaternionData();
-                IMUCharacteristic->setValue(quaternionData, sizeof(quaternionData));
-                IMUCharacteristic->notify();
-                delay(10);
-            }
-        }
 
+    try {
         // For disconnecting
         if (!connected && prevConnected) {
             delay(500); // Allow BLE Stack a chance to get things ready
-            server->startAdvertising();
+            startAdvertising();
             prevConnected = connected;
         }
 
@@ -408,9 +1521,17 @@ void loop() {
         if (connected && !prevConnected) {
             prevConnected = connected;
         }
+
+        const uint32_t elapsed = micros() - lastReport;
+        if (elapsed >= PIPELINE_REPORT_INTERVAL * 1000) {
+            reportPipeline(elapsed);
+            lastReport = micros();
+        }
+
+        delay(100);
     } catch (const std::exception &ex) {
         Log.errorln("Loop execution failed - %s", ex.what());
     } catch (...) {
         Log.errorln("Loop execution failed - Unknown Error");
     }
-}
\ No newline at end of file
+}